@@ -0,0 +1,125 @@
+// 统计每个"请求"调用 malloc 的次数和耗时：global new/delete（原来的做法）
+// 对比 LockFreePoolResource 和请求级 MonotonicArena。
+//
+// g++ -std=c++20 -O2 -DNDEBUG -pthread AllocationBenchmark.cpp -o allocation_benchmark
+// （-DNDEBUG 关掉 SimpleSharedPtr 析构时的调试输出。）
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <memory_resource>
+#include <thread>
+#include <vector>
+
+#include "CoroutineUcontext2.hpp"
+#include "MemoryResource.hpp"
+#include "SimpleSharedPtr.hpp"
+#include "cpp/idioms/copy_on_write.hpp"
+
+// 在可执行文件里定义 malloc 会覆盖 glibc 的符号（ELF 符号插入），
+// libstdc++ 的 operator new 也会走到这里，所以计数包含所有堆分配。
+extern "C" void *__libc_malloc(std::size_t size);
+
+static std::atomic<std::size_t> g_mallocCalls { 0 };
+
+extern "C" void *malloc(std::size_t size) noexcept
+{
+    g_mallocCalls.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+struct Order {
+    int id;
+    double price;
+    char symbol[16];
+};
+
+constexpr std::size_t kSharedPerRequest = 8;
+constexpr std::size_t kCowPerRequest = 8;
+constexpr std::size_t kStackSize = 64 * 1024;
+
+/// 一个请求：若干共享对象、COW 快照加一次写入、一个协程。
+/// resource 为空时走原来的 new/make_shared 路径。调度上下文属于工作线程，不算在请求里。
+void HandleRequest(CoroContext &context, std::pmr::memory_resource *resource, int requestId)
+{
+    SimpleSharedPtr<Order> orders[kSharedPerRequest];
+    for (std::size_t i = 0; i < kSharedPerRequest; ++i) {
+        if (resource) {
+            orders[i] = AllocateSharedPtr<Order>(resource, Order { requestId, 1.0 * i, "ACME" });
+        } else {
+            orders[i] = MakeSharedPtr<Order>(Order { requestId, 1.0 * i, "ACME" });
+        }
+    }
+
+    std::pmr::memory_resource *cowResource = resource ? resource : std::pmr::new_delete_resource();
+    for (std::size_t i = 0; i < kCowPerRequest; ++i) {
+        CopyOnWritePtr<Order> doc { std::allocator_arg, cowResource, *orders[i].Get() };
+        CopyOnWritePtr<Order> snapshot = doc;
+        doc.GetMut()->price += 1.0; // detach
+    }
+
+    CoroTask co { context, kStackSize, [&orders](CoroTask &self) {
+        for (auto &order : orders) {
+            order.Get()->price *= 2;
+            self.Yield();
+        }
+    }, resource ? resource : std::pmr::new_delete_resource() };
+    while (!co) {
+        co.Resume();
+    }
+}
+
+template<typename Fn>
+void Run(const char *name, int requests, Fn &&handle)
+{
+    // 预热一轮，让池子和 arena 达到稳定状态。
+    for (int i = 0; i < 100; ++i) {
+        handle(i);
+    }
+    const std::size_t before = g_mallocCalls.load();
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < requests; ++i) {
+        handle(i);
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    const std::size_t calls = g_mallocCalls.load() - before;
+    std::printf("%-24s %8.2f malloc/request %10.1f ns/request\n", name,
+                double(calls) / requests,
+                double(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / requests);
+}
+
+int main(int argc, const char *argv[])
+{
+    constexpr int kRequests = 20000;
+    CoroContext context;
+
+    Run("global new/delete", kRequests, [&context](int i) { HandleRequest(context, nullptr, i); });
+
+    LockFreePoolResource pool;
+    Run("lock-free pool", kRequests, [&context, &pool](int i) { HandleRequest(context, &pool, i); });
+
+    MonotonicArena arena { 256 * 1024 };
+    Run("monotonic arena", kRequests, [&context, &arena](int i) {
+        HandleRequest(context, &arena, i);
+        arena.Reset(); // 一次性回收整个请求的内存
+    });
+
+    // 多线程共享同一个池子，顺便检验无锁空闲链表。
+    std::vector<std::thread> threads;
+    const std::size_t before = g_mallocCalls.load();
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&pool]() {
+            CoroContext context;
+            for (int i = 0; i < kRequests / 4; ++i) {
+                HandleRequest(context, &pool, i);
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    std::printf("%-24s %8.2f malloc/request\n", "lock-free pool, 4 thr",
+                double(g_mallocCalls.load() - before) / kRequests);
+    return 0;
+}
@@ -0,0 +1,624 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "CoroutineUcontext2.hpp"
+#include "thread_pool_v0.hpp"
+
+/// 一次异步 I/O 操作，放在发起它的协程栈上，完成前协程不会返回，所以不需要堆分配。
+struct IoOp {
+    enum class Kind { Read, Write, ReadFixed, WriteFixed, Recv, Send, Accept };
+
+    Kind kind;
+    int fd;
+    void *buf;
+    std::size_t len;
+    std::uint64_t offset;
+    int bufIndex;
+    CoroTask *task = nullptr;
+    int result = 0; // 与 io_uring 一致：成功为字节数或新的 fd，失败为 -errno
+};
+
+/// I/O 后端：Prepare 只把操作排队，Poll 统一提交并收割完成的操作。
+class IoBackend {
+public:
+    virtual ~IoBackend() = default;
+
+    virtual const char *Name() const = 0;
+
+    virtual void Prepare(IoOp *op) = 0;
+
+    /// 提交排队的操作，把已完成的追加到 completed；wait 为 true 时至少等到一个完成。
+    virtual void Poll(bool wait, std::vector<IoOp *> &completed) = 0;
+
+    /// 注册给 ReadFixed/WriteFixed 使用的缓冲区，bufIndex 是在 buffers 中的下标。
+    virtual bool RegisterBuffers(std::span<const iovec> buffers) = 0;
+};
+
+/// 直接用系统调用操作 io_uring，不依赖 liburing。
+/**
+ * 一个调度轮次内所有协程发起的 SQE 先只写进共享内存里的提交队列，
+ * 到 Poll 时才用一次 io_uring_enter 全部提交并等待完成，系统调用次数与操作数无关。
+ * 内核不支持或被禁用（seccomp、kernel.io_uring_disabled）时 Create 返回空。
+ */
+class IoUringBackend : public IoBackend {
+public:
+    static std::unique_ptr<IoUringBackend> Create(unsigned entries)
+    {
+        io_uring_params params {};
+        const int fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (fd < 0) {
+            return nullptr;
+        }
+        std::unique_ptr<IoUringBackend> backend { new IoUringBackend { fd, params } };
+        if (!backend->Map()) {
+            return nullptr;
+        }
+        return backend;
+    }
+
+    IoUringBackend(const IoUringBackend &) = delete;
+    IoUringBackend &operator=(const IoUringBackend &) = delete;
+
+    ~IoUringBackend() override
+    {
+        if (m_sqes != MAP_FAILED) {
+            munmap(m_sqes, m_params.sq_entries * sizeof(io_uring_sqe));
+        }
+        if (m_cqRing != MAP_FAILED && m_cqRing != m_sqRing) {
+            munmap(m_cqRing, m_cqRingSize);
+        }
+        if (m_sqRing != MAP_FAILED) {
+            munmap(m_sqRing, m_sqRingSize);
+        }
+        close(m_fd);
+    }
+
+    const char *Name() const override
+    {
+        return "io_uring";
+    }
+
+    void Prepare(IoOp *op) override
+    {
+        // 提交队列满了才提前进入内核，正常情况下每轮只有 Poll 里的一次。
+        // 完成队列积压（EBUSY/EAGAIN）或只提交了一部分时队列可能仍然是满的，
+        // 这时收割完成的操作（留到下一次 Poll 交出去），让内核腾出空间再试。
+        while (m_sqTail - Load(m_sqHead) == m_params.sq_entries) {
+            try {
+                Enter(0, 0);
+                if (m_sqTail - Load(m_sqHead) < m_params.sq_entries) {
+                    break;
+                }
+                const std::size_t before = m_reaped.size();
+                Reap(m_reaped);
+                if (m_reaped.size() == before) {
+                    Enter(1, 0);
+                    Reap(m_reaped);
+                }
+            } catch (const std::system_error &e) {
+                // 不可恢复的错误：这个操作直接以 -errno 完成，下一次 Poll 会抛出同样的错误。
+                op->result = -e.code().value();
+                m_reaped.push_back(op);
+                return;
+            }
+        }
+        const unsigned index = m_sqTail & *m_sqMask;
+        io_uring_sqe &sqe = m_sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.fd = op->fd;
+        sqe.addr = reinterpret_cast<std::uint64_t>(op->buf);
+        sqe.len = static_cast<std::uint32_t>(op->len);
+        sqe.off = op->offset;
+        sqe.user_data = reinterpret_cast<std::uint64_t>(op);
+        switch (op->kind) {
+        case IoOp::Kind::Read:       sqe.opcode = IORING_OP_READ; break;
+        case IoOp::Kind::Write:      sqe.opcode = IORING_OP_WRITE; break;
+        case IoOp::Kind::ReadFixed:  sqe.opcode = IORING_OP_READ_FIXED; sqe.buf_index = op->bufIndex; break;
+        case IoOp::Kind::WriteFixed: sqe.opcode = IORING_OP_WRITE_FIXED; sqe.buf_index = op->bufIndex; break;
+        case IoOp::Kind::Recv:       sqe.opcode = IORING_OP_RECV; sqe.off = 0; break;
+        case IoOp::Kind::Send:       sqe.opcode = IORING_OP_SEND; sqe.off = 0; break;
+        case IoOp::Kind::Accept:     sqe.opcode = IORING_OP_ACCEPT; sqe.addr = 0; sqe.off = 0; sqe.len = 0;
+                                     sqe.accept_flags = SOCK_CLOEXEC; break;
+        }
+        m_sqArray[index] = index;
+        ++m_sqTail;
+    }
+
+    /// io_uring_enter 出现 EINTR/EBUSY/EAGAIN 以外的错误时抛出 std::system_error。
+    void Poll(bool wait, std::vector<IoOp *> &completed) override
+    {
+        const std::size_t before = completed.size();
+        completed.insert(completed.end(), m_reaped.begin(), m_reaped.end());
+        m_reaped.clear();
+        Reap(completed);
+        Enter(wait && completed.size() == before ? 1 : 0, 0);
+        Reap(completed);
+    }
+
+    bool RegisterBuffers(std::span<const iovec> buffers) override
+    {
+        return syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_BUFFERS,
+                       buffers.data(), static_cast<unsigned>(buffers.size())) == 0;
+    }
+
+    /// 进入内核的次数，用来观察批量提交的效果。
+    std::uint64_t Enters() const
+    {
+        return m_enters;
+    }
+
+private:
+    IoUringBackend(int fd, const io_uring_params &params)
+        : m_fd { fd }
+        , m_params { params }
+    { }
+
+    bool Map()
+    {
+        m_sqRingSize = m_params.sq_off.array + m_params.sq_entries * sizeof(std::uint32_t);
+        m_cqRingSize = m_params.cq_off.cqes + m_params.cq_entries * sizeof(io_uring_cqe);
+        const bool single = m_params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) {
+            m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+        }
+        m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        m_fd, IORING_OFF_SQ_RING);
+        if (m_sqRing == MAP_FAILED) {
+            return false;
+        }
+        m_cqRing = single ? m_sqRing
+                          : mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                 m_fd, IORING_OFF_CQ_RING);
+        if (m_cqRing == MAP_FAILED) {
+            return false;
+        }
+        auto sqes = mmap(nullptr, m_params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            return false;
+        }
+        m_sqes = static_cast<io_uring_sqe *>(sqes);
+
+        auto sq = static_cast<std::uint8_t *>(m_sqRing);
+        m_sqHead = reinterpret_cast<std::uint32_t *>(sq + m_params.sq_off.head);
+        m_sqTailShared = reinterpret_cast<std::uint32_t *>(sq + m_params.sq_off.tail);
+        m_sqMask = reinterpret_cast<std::uint32_t *>(sq + m_params.sq_off.ring_mask);
+        m_sqArray = reinterpret_cast<std::uint32_t *>(sq + m_params.sq_off.array);
+        m_sqTail = *m_sqTailShared;
+
+        auto cq = static_cast<std::uint8_t *>(m_cqRing);
+        m_cqHead = reinterpret_cast<std::uint32_t *>(cq + m_params.cq_off.head);
+        m_cqTail = reinterpret_cast<std::uint32_t *>(cq + m_params.cq_off.tail);
+        m_cqMask = reinterpret_cast<std::uint32_t *>(cq + m_params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<io_uring_cqe *>(cq + m_params.cq_off.cqes);
+        return true;
+    }
+
+    static std::uint32_t Load(std::uint32_t *p)
+    {
+        return std::atomic_ref<std::uint32_t> { *p }.load(std::memory_order_acquire);
+    }
+
+    static void Store(std::uint32_t *p, std::uint32_t v)
+    {
+        std::atomic_ref<std::uint32_t> { *p }.store(v, std::memory_order_release);
+    }
+
+    /// 发布本地写好的 SQE 并进入内核，minComplete > 0 时阻塞到有这么多完成。
+    /**
+     * EBUSY/EAGAIN（完成队列积压）返回后由调用者收割再进入；其它错误（EBADF、EFAULT、EINVAL 等）
+     * 重试也不会好转，抛出 std::system_error，而不是让 Run 在 Poll 上空转。
+     */
+    void Enter(unsigned minComplete, unsigned flags)
+    {
+        // 内核读 SQE 之前必须能看到它们的内容，所以用 release 发布 tail。
+        Store(m_sqTailShared, m_sqTail);
+        const unsigned toSubmit = m_sqTail - Load(m_sqHead);
+        if (toSubmit == 0 && minComplete == 0) {
+            return;
+        }
+        if (minComplete > 0) {
+            flags |= IORING_ENTER_GETEVENTS;
+        }
+        for (;;) {
+            ++m_enters;
+            const long ret = syscall(__NR_io_uring_enter, m_fd, toSubmit, minComplete, flags, nullptr, 0);
+            if (ret >= 0 || errno == EBUSY || errno == EAGAIN) {
+                return;
+            }
+            if (errno != EINTR) {
+                throw std::system_error { errno, std::system_category(), "io_uring_enter" };
+            }
+        }
+    }
+
+    void Reap(std::vector<IoOp *> &completed)
+    {
+        std::uint32_t head = *m_cqHead; // 只有我们写 head
+        const std::uint32_t tail = Load(m_cqTail);
+        for (; head != tail; ++head) {
+            const io_uring_cqe &cqe = m_cqes[head & *m_cqMask];
+            auto op = reinterpret_cast<IoOp *>(cqe.user_data);
+            op->result = cqe.res;
+            completed.push_back(op);
+        }
+        Store(m_cqHead, head);
+    }
+
+private:
+    int m_fd;
+    io_uring_params m_params;
+    void *m_sqRing { MAP_FAILED };
+    void *m_cqRing { MAP_FAILED };
+    std::size_t m_sqRingSize { 0 };
+    std::size_t m_cqRingSize { 0 };
+    io_uring_sqe *m_sqes { static_cast<io_uring_sqe *>(MAP_FAILED) };
+    std::uint32_t *m_sqHead { nullptr };
+    std::uint32_t *m_sqTailShared { nullptr };
+    std::uint32_t *m_sqMask { nullptr };
+    std::uint32_t *m_sqArray { nullptr };
+    std::uint32_t m_sqTail { 0 }; // 本地 tail，Enter 时才发布
+    std::vector<IoOp *> m_reaped; // Prepare 为腾出提交队列而提前收割的完成
+    std::uint32_t *m_cqHead { nullptr };
+    std::uint32_t *m_cqTail { nullptr };
+    std::uint32_t *m_cqMask { nullptr };
+    io_uring_cqe *m_cqes { nullptr };
+    std::uint64_t m_enters { 0 };
+};
+
+/// 没有 io_uring 时的后备：套接字用 epoll 等待就绪，文件读写交给线程池。
+/**
+ * 普通文件对 epoll 总是"就绪"（实际上 epoll_ctl 会返回 EPERM），读写仍会阻塞，
+ * 所以放到线程池里做 pread/pwrite，完成后经 eventfd 唤醒 epoll_wait。
+ * 套接字操作先乐观地以非阻塞方式尝试一次，EAGAIN 时才登记到 epoll。
+ * Accept 会把监听套接字设为 O_NONBLOCK。注册缓冲区只是记录下来，调试构建里用来检查
+ * ReadFixed/WriteFixed 的 buf 是否在第 bufIndex 个缓冲区之内（io_uring 的要求），
+ * 之后退化为普通读写。每个 fd 每个方向同一时刻只能有一个等待中的操作。
+ */
+class EpollBackend : public IoBackend {
+public:
+    explicit EpollBackend(std::size_t fileThreads = 4)
+        : m_epoll { epoll_create1(EPOLL_CLOEXEC) }
+        , m_event { eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC) }
+        , m_files { fileThreads }
+    {
+        epoll_event ev {};
+        ev.events = EPOLLIN;
+        ev.data.fd = m_event;
+        epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_event, &ev);
+    }
+
+    EpollBackend(const EpollBackend &) = delete;
+    EpollBackend &operator=(const EpollBackend &) = delete;
+
+    ~EpollBackend() override
+    {
+        m_files.stop();
+        m_files.join();
+        close(m_event);
+        close(m_epoll);
+    }
+
+    const char *Name() const override
+    {
+        return "epoll";
+    }
+
+    void Prepare(IoOp *op) override
+    {
+        switch (op->kind) {
+        case IoOp::Kind::ReadFixed:
+        case IoOp::Kind::WriteFixed:
+            assert(InRegisteredBuffer(*op) && "buf must lie within registered buffer bufIndex");
+            [[fallthrough]];
+        case IoOp::Kind::Read:
+        case IoOp::Kind::Write:
+            m_files.post([this, op]() {
+                const bool read = op->kind == IoOp::Kind::Read || op->kind == IoOp::Kind::ReadFixed;
+                const ssize_t n = read ? pread(op->fd, op->buf, op->len, static_cast<off_t>(op->offset))
+                                       : pwrite(op->fd, op->buf, op->len, static_cast<off_t>(op->offset));
+                op->result = n < 0 ? -errno : static_cast<int>(n);
+                {
+                    std::lock_guard lock { m_mutex };
+                    m_fileDone.push_back(op);
+                }
+                const std::uint64_t one = 1;
+                [[maybe_unused]] auto r = write(m_event, &one, sizeof(one));
+            });
+            break;
+        case IoOp::Kind::Accept:
+            fcntl(op->fd, F_SETFL, fcntl(op->fd, F_GETFL) | O_NONBLOCK);
+            [[fallthrough]];
+        case IoOp::Kind::Recv:
+        case IoOp::Kind::Send:
+            if (TrySocket(op)) {
+                m_immediate.push_back(op);
+            } else {
+                auto &waiters = m_waiters[op->fd];
+                auto &slot = op->kind == IoOp::Kind::Send ? waiters.out : waiters.in;
+                assert(!slot && "one pending operation per fd and direction");
+                slot = op;
+                Arm(op->fd, waiters);
+            }
+            break;
+        }
+    }
+
+    void Poll(bool wait, std::vector<IoOp *> &completed) override
+    {
+        completed.insert(completed.end(), m_immediate.begin(), m_immediate.end());
+        if (!m_immediate.empty()) {
+            wait = false;
+        }
+        m_immediate.clear();
+
+        epoll_event events[64];
+        int n;
+        do {
+            n = epoll_wait(m_epoll, events, 64, wait ? -1 : 0);
+        } while (n < 0 && errno == EINTR);
+        for (int i = 0; i < n; ++i) {
+            const int fd = events[i].data.fd;
+            if (fd == m_event) {
+                std::uint64_t count;
+                [[maybe_unused]] auto r = read(m_event, &count, sizeof(count));
+                std::lock_guard lock { m_mutex };
+                completed.insert(completed.end(), m_fileDone.begin(), m_fileDone.end());
+                m_fileDone.clear();
+                continue;
+            }
+            auto it = m_waiters.find(fd);
+            if (it == m_waiters.end()) {
+                continue;
+            }
+            auto &waiters = it->second;
+            // 错误和挂断也要让等待者重试一次，把错误带回去。
+            const bool hup = events[i].events & (EPOLLERR | EPOLLHUP);
+            for (IoOp **slot : { &waiters.in, &waiters.out }) {
+                const auto ready = slot == &waiters.in ? EPOLLIN : EPOLLOUT;
+                if (*slot && ((events[i].events & ready) || hup) && TrySocket(*slot)) {
+                    completed.push_back(*slot);
+                    *slot = nullptr;
+                }
+            }
+            Arm(fd, waiters);
+        }
+    }
+
+    bool RegisterBuffers(std::span<const iovec> buffers) override
+    {
+        m_buffers.assign(buffers.begin(), buffers.end());
+        return true;
+    }
+
+private:
+    /// [buf, buf + len) 是否落在第 bufIndex 个注册缓冲区之内。
+    bool InRegisteredBuffer(const IoOp &op) const
+    {
+        if (op.bufIndex < 0 || static_cast<std::size_t>(op.bufIndex) >= m_buffers.size()) {
+            return false;
+        }
+        const iovec &b = m_buffers[op.bufIndex];
+        const auto base = reinterpret_cast<std::uintptr_t>(b.iov_base);
+        const auto p = reinterpret_cast<std::uintptr_t>(op.buf);
+        return p >= base && op.len <= b.iov_len && p - base <= b.iov_len - op.len;
+    }
+
+    struct FdWaiters {
+        IoOp *in { nullptr };
+        IoOp *out { nullptr };
+        bool registered { false };
+    };
+
+    /// 以非阻塞方式执行一次套接字操作，返回是否已完成（包括出错）。
+    static bool TrySocket(IoOp *op)
+    {
+        ssize_t n = 0;
+        switch (op->kind) {
+        case IoOp::Kind::Recv:   n = recv(op->fd, op->buf, op->len, MSG_DONTWAIT); break;
+        case IoOp::Kind::Send:   n = send(op->fd, op->buf, op->len, MSG_DONTWAIT | MSG_NOSIGNAL); break;
+        case IoOp::Kind::Accept: n = accept4(op->fd, nullptr, nullptr, SOCK_CLOEXEC); break;
+        default: assert(false);
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return false;
+        }
+        op->result = n < 0 ? -errno : static_cast<int>(n);
+        return true;
+    }
+
+    /// 按剩余的等待者更新 epoll 的关注事件，没有等待者时移除，避免 fd 被关闭重用后状态错乱。
+    void Arm(int fd, FdWaiters &waiters)
+    {
+        const std::uint32_t interest = (waiters.in ? EPOLLIN : 0u) | (waiters.out ? EPOLLOUT : 0u);
+        if (interest == 0) {
+            if (waiters.registered) {
+                epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, nullptr);
+            }
+            m_waiters.erase(fd);
+            return;
+        }
+        epoll_event ev {};
+        ev.events = interest;
+        ev.data.fd = fd;
+        epoll_ctl(m_epoll, waiters.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev);
+        waiters.registered = true;
+    }
+
+private:
+    int m_epoll;
+    int m_event;
+    std::unordered_map<int, FdWaiters> m_waiters;
+    std::vector<IoOp *> m_immediate;
+    std::mutex m_mutex;
+    std::vector<IoOp *> m_fileDone;
+    std::vector<iovec> m_buffers;
+    thread_pool m_files;
+};
+
+/// 协程的异步 I/O：发起操作的协程让出，调度器在操作完成后恢复它。
+/**
+ * 所有接口在协程内调用，返回值与 io_uring 的 CQE 一致（失败为 -errno）。
+ * @code
+ * CoroContext context;
+ * CoroIo io { context };
+ * CoroTask reader { context, 64 * 1024, [&](CoroTask &self) {
+ *     char buf[4096];
+ *     int n = io.Read(self, fd, buf, sizeof(buf), 0);
+ * } };
+ * io.Spawn(reader);
+ * io.Run();
+ * @endcode
+ */
+class CoroIo {
+public:
+    enum class Backend { Auto, IoUring, Epoll };
+
+    explicit CoroIo(CoroContext &context, Backend backend = Backend::Auto, unsigned entries = 256)
+        : m_context { context }
+    {
+        if (backend != Backend::Epoll) {
+            m_backend = IoUringBackend::Create(entries);
+        }
+        if (!m_backend) {
+            m_backend = std::make_unique<EpollBackend>();
+        }
+    }
+
+    ~CoroIo()
+    {
+        assert(m_inFlight == 0);
+    }
+
+    const char *BackendName() const
+    {
+        return m_backend->Name();
+    }
+
+    IoBackend &GetBackend()
+    {
+        return *m_backend;
+    }
+
+    /// 累计发起的操作数。
+    std::uint64_t Submitted() const
+    {
+        return m_submitted;
+    }
+
+    /// 注册固定缓冲区：内核一次性固定页面，之后的 ReadFixed/WriteFixed 免去每次的页表查找和引用计数。
+    bool RegisterBuffers(std::span<const iovec> buffers)
+    {
+        return m_backend->RegisterBuffers(buffers);
+    }
+
+    int Read(CoroTask &self, int fd, void *buf, std::size_t len, std::uint64_t offset)
+    {
+        return Await(self, { IoOp::Kind::Read, fd, buf, len, offset, 0 });
+    }
+
+    int Write(CoroTask &self, int fd, const void *buf, std::size_t len, std::uint64_t offset)
+    {
+        return Await(self, { IoOp::Kind::Write, fd, const_cast<void *>(buf), len, offset, 0 });
+    }
+
+    /// buf 必须位于第 bufIndex 个注册缓冲区之内。
+    int ReadFixed(CoroTask &self, int fd, int bufIndex, void *buf, std::size_t len, std::uint64_t offset)
+    {
+        return Await(self, { IoOp::Kind::ReadFixed, fd, buf, len, offset, bufIndex });
+    }
+
+    int WriteFixed(CoroTask &self, int fd, int bufIndex, const void *buf, std::size_t len, std::uint64_t offset)
+    {
+        return Await(self, { IoOp::Kind::WriteFixed, fd, const_cast<void *>(buf), len, offset, bufIndex });
+    }
+
+    int Recv(CoroTask &self, int fd, void *buf, std::size_t len)
+    {
+        return Await(self, { IoOp::Kind::Recv, fd, buf, len, 0, 0 });
+    }
+
+    int Send(CoroTask &self, int fd, const void *buf, std::size_t len)
+    {
+        return Await(self, { IoOp::Kind::Send, fd, const_cast<void *>(buf), len, 0, 0 });
+    }
+
+    /// 返回新连接的 fd。
+    int Accept(CoroTask &self, int listenFd)
+    {
+        return Await(self, { IoOp::Kind::Accept, listenFd, nullptr, 0, 0, 0 });
+    }
+
+    ///
+    void Spawn(CoroTask &task)
+    {
+        m_context.Resume(&task);
+    }
+
+    /// 事件循环：运行所有就绪的协程，然后一次提交它们发起的全部 I/O，等待完成后再恢复对应的协程。
+    /// 没有就绪的协程、也没有进行中的 I/O 时返回。后端出现不可恢复的错误时抛出 std::system_error。
+    void Run()
+    {
+        std::vector<IoOp *> completed;
+        for (;;) {
+            m_context.Schedule();
+            if (m_inFlight == 0) {
+                return;
+            }
+            completed.clear();
+            m_backend->Poll(true, completed);
+            for (IoOp *op : completed) {
+                --m_inFlight;
+                m_context.Resume(op->task);
+            }
+        }
+    }
+
+private:
+    int Await(CoroTask &self, IoOp op)
+    {
+        op.task = &self;
+        m_backend->Prepare(&op);
+        ++m_inFlight;
+        ++m_submitted;
+        // 不能用 Yield()：恢复时操作已经完成，在取回结果之前抛出的话，
+        // Accept 得到的 fd 就泄漏了。先取回结果，再检查停止令牌。
+        self.Suspend();
+        if (self.GetStopToken().stop_requested()) {
+            if (op.kind == IoOp::Kind::Accept && op.result >= 0) {
+                close(op.result);
+            }
+            throw CoroCancelled {};
+        }
+        return op.result;
+    }
+
+private:
+    CoroContext &m_context;
+    std::unique_ptr<IoBackend> m_backend;
+    std::size_t m_inFlight { 0 };
+    std::uint64_t m_submitted { 0 };
+};
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/// 一个协程（或线程）的协程局部变量表：按槽位下标存放类型擦除的指针。
+/**
+ * 协程切换时只交换一个 thread_local 指针（Swap），访问一个变量是
+ * 一次 thread_local 读取加一次数组索引，没有哈希表查找。
+ * 协程迁移到别的线程上恢复时，恢复它的线程会把指针换成它的表，值跟着协程走。
+ */
+class CoroLocalStorage {
+public:
+    using Deleter = void (*)(void *);
+
+    static constexpr std::size_t kMaxSlots = 256;
+
+    CoroLocalStorage() = default;
+
+    CoroLocalStorage(CoroLocalStorage &&) = default;
+    CoroLocalStorage &operator=(CoroLocalStorage &&) = delete;
+    CoroLocalStorage(const CoroLocalStorage &) = delete;
+    CoroLocalStorage &operator=(const CoroLocalStorage &) = delete;
+
+    ~CoroLocalStorage()
+    {
+        for (std::size_t i = 0; i < m_values.size(); ++i) {
+            if (m_values[i]) {
+                Deleters()[i].load(std::memory_order_acquire)(m_values[i]);
+            }
+        }
+    }
+
+    void *Get(std::size_t index) const
+    {
+        return index < m_values.size() ? m_values[index] : nullptr;
+    }
+
+    void Set(std::size_t index, void *value)
+    {
+        if (index >= m_values.size()) {
+            m_values.resize(index + 1);
+        }
+        m_values[index] = value;
+    }
+
+    /// 当前线程上正在运行的协程的表，不在协程里时是线程自己的表。
+    static CoroLocalStorage &Current()
+    {
+        CoroLocalStorage *current = CurrentSlot();
+        return current ? *current : ThreadStorage();
+    }
+
+    /// 切换到 next 的表，返回之前的，由协程的 Resume 成对调用。
+    static CoroLocalStorage *Swap(CoroLocalStorage *next)
+    {
+        return std::exchange(CurrentSlot(), next);
+    }
+
+    /// 分配一个全局槽位，槽位不回收，所以 CoroLocal 应当是静态的。
+    /// 超过 kMaxSlots 个时抛出 std::length_error（Release 构建里 assert 不起作用）。
+    static std::size_t AllocateSlot(Deleter deleter)
+    {
+        static std::atomic<std::size_t> next { 0 };
+        const std::size_t index = next.fetch_add(1, std::memory_order_relaxed);
+        assert(index < kMaxSlots && "too many CoroLocal variables");
+        if (index >= kMaxSlots) {
+            throw std::length_error { "CoroLocalStorage: too many CoroLocal variables" };
+        }
+        Deleters()[index].store(deleter, std::memory_order_release);
+        return index;
+    }
+
+private:
+    // 常量初始化的 thread_local，访问时没有初始化检查。
+    static CoroLocalStorage *&CurrentSlot()
+    {
+        static thread_local CoroLocalStorage *current = nullptr;
+        return current;
+    }
+
+    static CoroLocalStorage &ThreadStorage()
+    {
+        static thread_local CoroLocalStorage storage;
+        return storage;
+    }
+
+    static std::array<std::atomic<Deleter>, kMaxSlots> &Deleters()
+    {
+        static std::array<std::atomic<Deleter>, kMaxSlots> deleters {};
+        return deleters;
+    }
+
+private:
+    std::vector<void *> m_values;
+};
+
+/// 协程局部变量：每个协程各有一份，第一次在某个协程里访问时值初始化，协程销毁时析构。
+/**
+ * 新协程不继承创建者的值。不在协程里访问时得到的是当前线程自己的那份。
+ * @code
+ * static CoroLocal<RequestContext> tRequest;
+ * tRequest.Get().id = 42;   // 只影响当前协程
+ * @endcode
+ */
+template<typename T>
+class CoroLocal {
+public:
+    CoroLocal()
+        : m_index { CoroLocalStorage::AllocateSlot([](void *p) { delete static_cast<T *>(p); }) }
+    { }
+
+    CoroLocal(const CoroLocal &) = delete;
+    CoroLocal &operator=(const CoroLocal &) = delete;
+
+    T &Get()
+    {
+        CoroLocalStorage &storage = CoroLocalStorage::Current();
+        void *value = storage.Get(m_index);
+        if (!value) {
+            value = new T {};
+            storage.Set(m_index, value);
+        }
+        return *static_cast<T *>(value);
+    }
+
+    /// 当前协程还没有访问过时返回空。
+    T *TryGet() const
+    {
+        return static_cast<T *>(CoroLocalStorage::Current().Get(m_index));
+    }
+
+    void Set(T value)
+    {
+        Get() = std::move(value);
+    }
+
+private:
+    std::size_t m_index;
+};
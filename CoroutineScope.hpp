@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <list>
+#include <memory>
+#include <memory_resource>
+#include <stop_token>
+#include <utility>
+
+#include "CoroutineUcontext2.hpp"
+
+/// 协程版本的 task_scope：拥有在它之下 Spawn 的子协程，Join 之后它们全部结束。
+/**
+ * 子协程的 CoroTask 带上 scope 的停止令牌，取消后在下一个挂起点（Yield 返回时）
+ * 抛出 CoroCancelled 展开栈，所以被取消的工作最多再运行到一个挂起点。
+ * 挂起在 CoroIo 操作上的协程要等该操作完成、被恢复时才看到取消。
+ * 第一个抛出异常的子协程让整个 scope 取消，Join 重新抛出这个异常。
+ * @code
+ * CoroTask parent { context, kStackSize, [&](CoroTask &self) {
+ *     CoroScope scope { context, self.GetStopToken() };
+ *     scope.Spawn([&](CoroTask &child) { ... child.Yield(); ... });
+ *     scope.Join(); // 挂起 parent，最后一个子协程结束时恢复它
+ * } };
+ * @endcode
+ */
+class CoroScope {
+public:
+    explicit CoroScope(CoroContext &context, std::stop_token parent = {}, std::size_t stackSize = 64 * 1024,
+                       std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+        : m_context { context }
+        , m_stackSize { stackSize }
+        , m_resource { resource }
+        , m_link { std::move(parent), ForwardStop { &m_source } }
+    { }
+
+    CoroScope(const CoroScope &) = delete;
+    CoroScope &operator=(const CoroScope &) = delete;
+
+    /// 没有 Join 就离开作用域（比如异常）时，先取消再等待子协程结束，不抛出它们的异常。
+    ~CoroScope()
+    {
+        if (m_pending > 0) {
+            RequestStop();
+            WaitChildren();
+        }
+    }
+
+    /// 子协程加入就绪队列，由 CoroContext 调度。scope 已取消时不再启动新的子协程。
+    void Spawn(std::function<void (CoroTask &)> fn)
+    {
+        if (m_source.stop_requested()) {
+            return;
+        }
+        Reap();
+        ++m_pending;
+        auto &child = m_children.emplace_back(std::make_unique<CoroTask>(m_context, m_stackSize,
+            [this, fn = std::move(fn)](CoroTask &self) {
+                Run(fn, self);
+                Finish();
+            }, m_resource));
+        child->SetStopToken(m_source.get_token());
+        m_context.Resume(child.get());
+    }
+
+    /// 等待所有子协程结束，重新抛出第一个异常。
+    /**
+     * 在协程里调用时挂起当前协程；在协程外调用时驱动 CoroContext::Schedule，
+     * 这种情况下子协程不能等待 Schedule 驱动不了的东西（用 CoroIo 时请在协程里 Join）。
+     */
+    void Join()
+    {
+        WaitChildren();
+        if (m_error) {
+            std::rethrow_exception(std::exchange(m_error, nullptr));
+        }
+    }
+
+    void RequestStop()
+    {
+        m_source.request_stop();
+    }
+
+    std::stop_token GetToken() const
+    {
+        return m_source.get_token();
+    }
+
+private:
+    struct ForwardStop {
+        std::stop_source *target;
+
+        void operator()() const noexcept
+        {
+            target->request_stop();
+        }
+    };
+
+    void Run(const std::function<void (CoroTask &)> &fn, CoroTask &self)
+    {
+        // 启动之前已经取消的子协程不运行。
+        if (m_source.stop_requested()) {
+            return;
+        }
+        try {
+            fn(self);
+        } catch (const CoroCancelled &) {
+        } catch (...) {
+            if (!m_error) {
+                m_error = std::current_exception();
+            }
+            RequestStop();
+        }
+    }
+
+    void Finish()
+    {
+        if (--m_pending == 0 && m_waiter) {
+            m_context.Resume(std::exchange(m_waiter, nullptr));
+        }
+    }
+
+    void WaitChildren()
+    {
+        if (CoroTask *self = m_context.Current()) {
+            while (m_pending > 0) {
+                m_waiter = self;
+                // 父协程即使已被取消也必须等子协程结束，所以不用 Yield。
+                self->Suspend();
+            }
+        } else {
+            m_context.Schedule();
+            assert(m_pending == 0 && "children wait on something Schedule() cannot drive; Join from a coroutine");
+        }
+        m_children.clear();
+    }
+
+    /// 回收已结束的子协程的栈。子协程结束时已经切换回调度者，可以安全析构。
+    void Reap()
+    {
+        m_children.remove_if([](const std::unique_ptr<CoroTask> &child) { return static_cast<bool>(*child); });
+    }
+
+private:
+    CoroContext &m_context;
+    std::size_t m_stackSize;
+    std::pmr::memory_resource *m_resource;
+    std::stop_source m_source;
+    // 必须在 m_source 之后构造：父令牌已停止时回调在构造函数里就会执行。
+    std::stop_callback<ForwardStop> m_link;
+    std::list<std::unique_ptr<CoroTask>> m_children;
+    std::size_t m_pending = 0;
+    CoroTask *m_waiter = nullptr;
+    std::exception_ptr m_error;
+};
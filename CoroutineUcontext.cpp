@@ -1,10 +1,14 @@
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <utility>
 
 #include <unistd.h>
 #include <ucontext.h>
 
+#include "CoroutineUcontext.hpp"
+#include "Generator.hpp"
+
 void test1()
 {
     ucontext_t context;
@@ -38,55 +42,6 @@ void test2()
     std::cout << "main" << std::endl;    
 }
 
-// ref: https://probablydance.com/2012/11/18/implementing-coroutines-with-ucontext/
-class SimpleCoroutine {
-public:
-    SimpleCoroutine(size_t stackSize, std::function<void (SimpleCoroutine&)> task)
-    {
-        getcontext(&m_callee);
-        m_task = task;
-        m_stack = std::make_unique<uint8_t[]>(stackSize);
-        m_callee.uc_stack.ss_sp = m_stack.get();
-        m_callee.uc_stack.ss_size = stackSize;
-        m_callee.uc_stack.ss_flags = 0;
-        m_callee.uc_link = &m_caller;
-        makecontext(&m_callee, reinterpret_cast<void (*)()>(coroutine), 1, reinterpret_cast<void *>(this)); //!! size of argument?
-    }
-
-    //!! 还应该考虑resume操作和协程的对称性，两者可以方便我们编写异步操作。
-    //!! 比如，一个背景线程监听某个fd事件，若事件发生，该线程可以通过映射表
-    //!! 找出对应的协程，然后resume该协程。
-    void yield()
-    {
-        swapcontext(&m_callee, &m_caller);
-    }
-
-    void operator()()
-    {
-        if (finished) return;
-        swapcontext(&m_caller, &m_callee);
-    }
-
-    operator bool() const
-    {
-        return finished;
-    }
-
-private:
-    bool finished = false;
-    ucontext_t m_caller;
-    ucontext_t m_callee; //!! memory overhead, should be thread-local storage
-    std::unique_ptr<uint8_t[]> m_stack;
-    std::function<void (SimpleCoroutine&)> m_task;
-
-    static void coroutine(void *self)
-    {
-        SimpleCoroutine *c = reinterpret_cast<SimpleCoroutine *>(self);
-        c->m_task(*c);
-        c->finished = true;
-    }
-};
-
 int main(int argc, const char* argv[])
 {
     //test2();
@@ -102,6 +57,19 @@ int main(int argc, const char* argv[])
         co();
     }
 
+    // 无限的斐波那契数列，下游 take 取够之后生产者就不再运行。
+    generator<long> fib { [](generator<long>::yielder& yield) {
+        long a = 0, b = 1;
+        for (;;) {
+            yield(a);
+            b = std::exchange(a, b) + b;
+        }
+    } };
+    for (long v : fib | filter([](long v) { return v % 2 == 0; }) | map([](long v) { return v / 2; }) | take(10)) {
+        std::cout << v << " ";
+    }
+    std::cout << std::endl;
+
     return 0;
 }
 
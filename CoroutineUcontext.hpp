@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include <ucontext.h>
+
+#include "CoroutineLocal.hpp"
+
+// ref: https://probablydance.com/2012/11/18/implementing-coroutines-with-ucontext/
+class SimpleCoroutine {
+public:
+    SimpleCoroutine(size_t stackSize, std::function<void (SimpleCoroutine&)> task)
+    {
+        getcontext(&m_callee);
+        m_task = task;
+        m_stack = std::make_unique<uint8_t[]>(stackSize);
+        m_callee.uc_stack.ss_sp = m_stack.get();
+        m_callee.uc_stack.ss_size = stackSize;
+        m_callee.uc_stack.ss_flags = 0;
+        m_callee.uc_link = &m_caller;
+        makecontext(&m_callee, reinterpret_cast<void (*)()>(coroutine), 1, reinterpret_cast<void *>(this)); //!! size of argument?
+    }
+
+    //!! 还应该考虑resume操作和协程的对称性，两者可以方便我们编写异步操作。
+    //!! 比如，一个背景线程监听某个fd事件，若事件发生，该线程可以通过映射表
+    //!! 找出对应的协程，然后resume该协程。
+    void yield()
+    {
+        swapcontext(&m_callee, &m_caller);
+    }
+
+    void operator()()
+    {
+        if (finished) return;
+        CoroLocalStorage *previousLocals = CoroLocalStorage::Swap(&m_locals);
+        swapcontext(&m_caller, &m_callee);
+        CoroLocalStorage::Swap(previousLocals);
+    }
+
+    operator bool() const
+    {
+        return finished;
+    }
+
+private:
+    bool finished = false;
+    ucontext_t m_caller;
+    ucontext_t m_callee; // 保存挂起时的寄存器，必须每个协程一份；每个请求的上下文数据放在 m_locals（见 CoroLocal）
+    std::unique_ptr<uint8_t[]> m_stack;
+    std::function<void (SimpleCoroutine&)> m_task;
+    CoroLocalStorage m_locals;
+
+    static void coroutine(void *self)
+    {
+        SimpleCoroutine *c = reinterpret_cast<SimpleCoroutine *>(self);
+        c->m_task(*c);
+        c->finished = true;
+    }
+};
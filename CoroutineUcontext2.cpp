@@ -1,100 +1,29 @@
-#include <functional>
+#include <atomic>
+#include <chrono>
 #include <iostream>
 #include <memory>
-#include <deque>
+#include <string>
+#include <unordered_map>
+#include <stdexcept>
+#include <vector>
 
-#include <unistd.h>
-#include <ucontext.h>
+#include "CoroutineLocal.hpp"
+#include "CoroutineScope.hpp"
+#include "CoroutineUcontext2.hpp"
+#include "thread_pool_v0.hpp"
 
-class CoroTask;
-
-class CoroContext {
-public:
-    ucontext_t &GetCallerContext()
-    {
-        return m_caller;
-    }
-    
-    void Resume(CoroTask *pCoroTask)
-    {
-        m_readyTasks.push_back(pCoroTask);
-    }
-    
-    void Schedule();
-    
-private:
-    ucontext_t m_caller;
-    std::deque<CoroTask *> m_readyTasks; //!! make thread-safe
+struct RequestContext {
+    int id = 0;
+    std::string user;
 };
 
-class CoroTask {
-public:
-    explicit CoroTask(CoroContext &context, std::size_t ssize, std::function<void (CoroTask &)> task)
-        : m_context { context }
-        , m_task { task }
-        , m_ssize { ssize }
-        , m_stack { new uint8_t[m_ssize] }
-    {
-        getcontext(&m_callee);
-        m_task = task;
-        m_callee.uc_stack.ss_sp = m_stack.get();
-        m_callee.uc_stack.ss_size = m_ssize;
-        m_callee.uc_stack.ss_flags = 0;
-        m_callee.uc_link = &m_context.GetCallerContext();
-        // On architectures where int and pointer types are the same size (e.g., x86-32, where both types are 32 bits),
-        // you may be able to get away with passing pointers as arguments to makecontext() following argc. However,
-        // doing this is not guaranteed to be portable, is undefined according to the standards, and won't work on
-        // architectures where pointers are larger than ints. Nevertheless, starting with version 2.8, glibc makes some
-        // changes to makecontext(), to permit this on some 64-bit architectures (e.g., x86-64). 
-        makecontext(&m_callee, reinterpret_cast<void (*)()>(RawTask), 1, reinterpret_cast<void *>(this));
-    }
-    
-    void Yield()
-    {
-        swapcontext(&m_callee, &m_context.GetCallerContext());
-    }
-    
-    void Resume()
-    {
-        if (done)
-            return;
-        swapcontext(&m_context.GetCallerContext(), &m_callee);
-    }
-    
-    operator bool()
-    {
-        return done;
-    }
-    
-    CoroTask() = delete;
-    CoroTask(const CoroTask &) = delete;
-    CoroTask &operator=(const CoroTask &) = delete;
-    CoroTask(CoroTask &&) = default;
-    CoroTask &operator=(CoroTask &&) = default;
-    
-private:
-    static void RawTask(void *arg)
-    {
-        auto pCoroTask = reinterpret_cast<CoroTask *>(arg);
-        pCoroTask->m_task(*pCoroTask);
-        pCoroTask->done = true;
-    }
-    
-private:
-    CoroContext &m_context;
-    ucontext_t m_callee;
-    std::function<void (CoroTask &)> m_task;
-    std::size_t m_ssize;
-    std::unique_ptr<uint8_t[]> m_stack;
-    bool done = false;
-};
+static CoroLocal<RequestContext> tRequest;
 
-void CoroContext::Schedule()
+/// 深处的代码直接拿到当前请求的上下文，不需要层层传参。
+void Log(const char* what)
 {
-    while (!m_readyTasks.empty()) {
-        m_readyTasks.front()->Resume();
-        m_readyTasks.pop_front();
-    }
+    const RequestContext& request = tRequest.Get();
+    std::cout << "[request " << request.id << " " << request.user << "] " << what << std::endl;
 }
 
 int main(int argc, const char* argv[])
@@ -112,6 +41,112 @@ int main(int argc, const char* argv[])
         co.Resume();
     }
 
+    // 结构化并发：一个子协程失败后，其余子协程在下一次 Yield 时被取消，
+    // parent 在 Join 处等它们全部结束后拿到异常。
+    int steps[4] = {};
+    CoroTask parent { context, 1024*1024, [&](CoroTask& self) {
+        CoroScope scope { context, self.GetStopToken() };
+        for (int k = 0; k < 4; ++k) {
+            scope.Spawn([&, k](CoroTask& child) {
+                for (;;) {
+                    if (k == 0 && steps[k] == 10) {
+                        throw std::runtime_error("child 0 failed");
+                    }
+                    ++steps[k];
+                    context.Resume(&child); // 让出给其它协程，稍后继续
+                    child.Yield();
+                }
+            });
+        }
+        try {
+            scope.Join();
+        } catch (const std::exception& e) {
+            std::cout << "scope failed: " << e.what() << std::endl;
+        }
+    }};
+    context.Resume(&parent);
+    context.Schedule();
+    std::cout << "steps before cancellation:";
+    for (int n : steps) {
+        std::cout << " " << n;
+    }
+    std::cout << std::endl;
+
+    // 两个请求交替运行，各自看到自己的上下文。
+    CoroTask requestA { context, 64*1024, [](CoroTask& self) {
+        tRequest.Set({ 1, "alice" });
+        Log("start");
+        self.Yield();
+        Log("done");
+    }};
+    CoroTask requestB { context, 64*1024, [](CoroTask& self) {
+        tRequest.Set({ 2, "bob" });
+        Log("start");
+        self.Yield();
+        Log("done");
+    }};
+    while (!requestA || !requestB) {
+        requestA.Resume();
+        requestB.Resume();
+    }
+
+    // 对比按协程指针查哈希表的做法。
+    constexpr int kLookups = 10000000;
+    std::unordered_map<const CoroTask*, RequestContext> byTask;
+    long sumLocal = 0, sumMap = 0;
+    double nsLocal = 0, nsMap = 0;
+    CoroTask bench { context, 64*1024, [&](CoroTask& self) {
+        tRequest.Get().id = 7;
+        byTask[&self].id = 7;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < kLookups; ++i) {
+            sumLocal += tRequest.Get().id;
+        }
+        nsLocal = double(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()) / kLookups;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < kLookups; ++i) {
+            sumMap += byTask.find(context.Current())->second.id;
+        }
+        nsMap = double(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()) / kLookups;
+    }};
+    bench.Resume();
+    std::cout << "CoroLocal::Get: " << nsLocal << " ns, unordered_map: " << nsMap << " ns ("
+              << sumLocal << "/" << sumMap << ")" << std::endl;
+
+    // 跨线程唤醒：协程把工作交给线程池后挂起，worker 做完后用 ResumeRemote 唤醒它。
+    // worker 可能在协程挂起之前就调用了 ResumeRemote，这没有关系：
+    // 调度者要等当前协程让出之后才会取走跨线程队列。
+    {
+        constexpr int kTasks = 8;
+        constexpr int kRounds = 10000;
+        thread_pool pool { 2 };
+        std::stop_source allDone;
+        int finished = 0;
+        long total = 0;
+        std::vector<std::unique_ptr<CoroTask>> tasks;
+        for (int k = 0; k < kTasks; ++k) {
+            tasks.push_back(std::make_unique<CoroTask>(context, 64*1024, [&](CoroTask& self) {
+                for (int r = 0; r < kRounds; ++r) {
+                    int result = 0;
+                    pool.post([&result, &self, &context, r]() {
+                        result = r;
+                        context.ResumeRemote(&self);
+                    });
+                    self.Suspend();
+                    total += result;
+                }
+                if (++finished == kTasks) {
+                    allDone.request_stop();
+                }
+            }));
+            context.Resume(tasks.back().get());
+        }
+        auto start = std::chrono::steady_clock::now();
+        context.Run(allDone.get_token());
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "remote resumes: " << kTasks * kRounds << " in " << us << " us, total " << total << std::endl;
+    }
+
     return 0;
 }
 
@@ -0,0 +1,347 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <span>
+#include <utility>
+#include <stop_token>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <ucontext.h>
+
+#include "CoroutineLocal.hpp"
+
+class CoroTask;
+
+/// 已请求停止的协程在挂起点（Yield 返回时）抛出，由 CoroTask 自己捕获，不会传出协程。
+struct CoroCancelled {};
+
+/// 协程调度器：一个线程运行 Schedule，其它线程可以经由 ResumeRemote 唤醒它的协程。
+/**
+ * 就绪队列是侵入式的，链接节点在 CoroTask 里，入队不分配内存。
+ * 一个协程同一时刻最多在队列里出现一次。
+ * - 本线程（调度者和它运行的协程）用 Resume，入的是不加锁的本地 FIFO；
+ * - 其它线程（I/O 完成、定时器、线程池 worker）用 ResumeRemote，一批协程用一次 CAS
+ *   压入无锁的 MPSC 栈，调度者每轮用一次 exchange 取走全部并还原顺序。
+ * 调度者在 WaitRemote 里睡眠时，队列由空变非空的那一批写一次 eventfd 唤醒它，
+ * 调度者醒着时不做系统调用。
+ * @code
+ * CoroContext context;
+ * std::jthread scheduler { [&](std::stop_token stop) { context.Run(stop); } };
+ * pool.post([&]() { ...; context.ResumeRemote(task); });
+ * @endcode
+ */
+class CoroContext {
+public:
+    CoroContext()
+        : m_event { eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC) }
+    { }
+
+    ~CoroContext()
+    {
+        close(m_event);
+    }
+
+    CoroContext(const CoroContext &) = delete;
+    CoroContext &operator=(const CoroContext &) = delete;
+
+    ucontext_t &GetCallerContext()
+    {
+        return m_caller;
+    }
+    
+    /// 只能在调度者线程上调用。
+    void Resume(CoroTask *pCoroTask);
+
+    /// 任何线程都可以调用。
+    void ResumeRemote(CoroTask *pCoroTask)
+    {
+        ResumeRemote(std::span<CoroTask *const> { &pCoroTask, 1 });
+    }
+
+    /// 整批只有一次 CAS、最多一次 eventfd 写，出队顺序与 tasks 相同。
+    void ResumeRemote(std::span<CoroTask *const> tasks);
+
+    /// 运行所有就绪的协程，直到本地和跨线程队列都空了，返回恢复的次数。
+    /**
+     * 每轮先取走跨线程队列，再运行到这一轮的最后一个，本轮中新入队的留到下一轮，
+     * 所以不停让出的协程不会饿死其它线程唤醒的协程。
+     */
+    std::size_t Schedule();
+
+    /// 阻塞到有 ResumeRemote 或 Notify，timeoutMs < 0 表示一直等。超时返回 false。
+    bool WaitRemote(int timeoutMs = -1);
+
+    /// 唤醒 WaitRemote，任何线程都可以调用。
+    void Notify()
+    {
+        eventfd_write(m_event, 1);
+    }
+
+    /// 交替 Schedule 与 WaitRemote，直到 stop 被请求。
+    void Run(std::stop_token stop);
+
+    /// 可读表示可能有跨线程唤醒，用来把调度者接进别的事件循环（之后调用 Schedule）。
+    int NotifyFd() const
+    {
+        return m_event;
+    }
+
+    /// 正在运行的协程，不在协程中时为空。
+    CoroTask *Current() const
+    {
+        return m_current;
+    }
+    
+private:
+    friend class CoroTask;
+
+    CoroTask *PopReady();
+    void DrainRemote();
+
+    ucontext_t m_caller;
+    CoroTask *m_current = nullptr;
+    // 本地 FIFO，只有调度者线程访问。
+    CoroTask *m_readyHead = nullptr;
+    CoroTask *m_readyTail = nullptr;
+    // 生产者争用的缓存行与调度者独占的字段分开。
+    alignas(64) std::atomic<CoroTask *> m_remote { nullptr };
+    std::atomic<bool> m_sleeping { false };
+    int m_event;
+};
+
+class CoroTask {
+public:
+    explicit CoroTask(CoroContext &context, std::size_t ssize, std::function<void (CoroTask &)> task,
+                      std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+        : m_context { context }
+        , m_task { task }
+        , m_ssize { ssize }
+        , m_stack { static_cast<uint8_t *>(resource->allocate(m_ssize, alignof(std::max_align_t))),
+                    StackDeleter { resource, m_ssize } }
+    {
+        getcontext(&m_callee);
+        m_task = task;
+        m_callee.uc_stack.ss_sp = m_stack.get();
+        m_callee.uc_stack.ss_size = m_ssize;
+        m_callee.uc_stack.ss_flags = 0;
+        m_callee.uc_link = &m_context.GetCallerContext();
+        // On architectures where int and pointer types are the same size (e.g., x86-32, where both types are 32 bits),
+        // you may be able to get away with passing pointers as arguments to makecontext() following argc. However,
+        // doing this is not guaranteed to be portable, is undefined according to the standards, and won't work on
+        // architectures where pointers are larger than ints. Nevertheless, starting with version 2.8, glibc makes some
+        // changes to makecontext(), to permit this on some 64-bit architectures (e.g., x86-64). 
+        makecontext(&m_callee, reinterpret_cast<void (*)()>(RawTask), 1, reinterpret_cast<void *>(this));
+    }
+    
+    /// 设置了停止令牌且已请求停止时，恢复后抛出 CoroCancelled 展开协程栈。
+    void Yield()
+    {
+        Suspend();
+        if (m_stopToken.stop_requested()) {
+            throw CoroCancelled {};
+        }
+    }
+
+    /// 不检查停止令牌的 Yield，用于取消后仍必须等待的地方（比如等子协程结束）。
+    void Suspend()
+    {
+        swapcontext(&m_callee, &m_context.GetCallerContext());
+    }
+
+    void SetStopToken(std::stop_token token)
+    {
+        m_stopToken = std::move(token);
+    }
+
+    const std::stop_token &GetStopToken() const
+    {
+        return m_stopToken;
+    }
+    
+    void Resume()
+    {
+        if (done)
+            return;
+        CoroTask *previous = std::exchange(m_context.m_current, this);
+        CoroLocalStorage *previousLocals = CoroLocalStorage::Swap(&m_locals);
+        swapcontext(&m_context.GetCallerContext(), &m_callee);
+        CoroLocalStorage::Swap(previousLocals);
+        m_context.m_current = previous;
+    }
+    
+    operator bool()
+    {
+        return done;
+    }
+    
+    ~CoroTask()
+    {
+        // 就绪队列里的其它协程或 CoroContext 还指向它，析构后就是悬空指针。
+        // 只能检查本地队列：跨线程栈的最后一个节点 m_readyNext 也为空。
+        assert(m_readyNext == nullptr && m_context.m_readyTail != this && "task destroyed while queued");
+    }
+
+    CoroTask() = delete;
+    CoroTask(const CoroTask &) = delete;
+    CoroTask &operator=(const CoroTask &) = delete;
+    // 不可移动：makecontext 捕获了 this，就绪队列也以地址链接协程。需要转移所有权时用 std::unique_ptr<CoroTask>。
+    CoroTask(CoroTask &&) = delete;
+    CoroTask &operator=(CoroTask &&) = delete;
+    
+private:
+    static void RawTask(void *arg)
+    {
+        auto pCoroTask = reinterpret_cast<CoroTask *>(arg);
+        // 异常不能越过 makecontext 的入口。
+        try {
+            pCoroTask->m_task(*pCoroTask);
+        } catch (const CoroCancelled &) {
+        }
+        pCoroTask->done = true;
+    }
+    
+private:
+    struct StackDeleter {
+        std::pmr::memory_resource *resource;
+        std::size_t size;
+
+        void operator()(uint8_t *stack) const
+        {
+            resource->deallocate(stack, size, alignof(std::max_align_t));
+        }
+    };
+
+private:
+    CoroContext &m_context;
+    ucontext_t m_callee;
+    std::function<void (CoroTask &)> m_task;
+    std::size_t m_ssize;
+    std::unique_ptr<uint8_t[], StackDeleter> m_stack;
+    std::stop_token m_stopToken;
+    CoroLocalStorage m_locals;
+    // 就绪队列的链接，本地 FIFO 和跨线程栈共用：一个协程同时只在一个队列里。
+    CoroTask *m_readyNext = nullptr;
+    bool done = false;
+
+    friend class CoroContext;
+};
+
+inline void CoroContext::Resume(CoroTask *pCoroTask)
+{
+    assert(pCoroTask->m_readyNext == nullptr && pCoroTask != m_readyTail && "task is already queued");
+    if (m_readyTail) {
+        m_readyTail->m_readyNext = pCoroTask;
+    } else {
+        m_readyHead = pCoroTask;
+    }
+    m_readyTail = pCoroTask;
+}
+
+inline void CoroContext::ResumeRemote(std::span<CoroTask *const> tasks)
+{
+    if (tasks.empty()) {
+        return;
+    }
+    // 栈是后进先出，批内逆序链接：栈顶是最后一个，DrainRemote 反转后恢复原来的顺序。
+    for (std::size_t i = 1; i < tasks.size(); ++i) {
+        tasks[i]->m_readyNext = tasks[i - 1];
+    }
+    CoroTask *top = tasks.back();
+    CoroTask *bottom = tasks.front();
+    CoroTask *head = m_remote.load(std::memory_order_relaxed);
+    do {
+        bottom->m_readyNext = head;
+    } while (!m_remote.compare_exchange_weak(head, top, std::memory_order_seq_cst, std::memory_order_relaxed));
+    // 与 WaitRemote 构成 Dekker 式的握手（两边都是 seq_cst）：要么我们看到它在睡眠，
+    // 要么它在睡眠之前看到队列非空。只有由空变非空的那一批需要唤醒。
+    if (head == nullptr && m_sleeping.load()) {
+        Notify();
+    }
+}
+
+inline CoroTask *CoroContext::PopReady()
+{
+    CoroTask *task = m_readyHead;
+    m_readyHead = task->m_readyNext;
+    if (!m_readyHead) {
+        m_readyTail = nullptr;
+    }
+    task->m_readyNext = nullptr;
+    return task;
+}
+
+inline void CoroContext::DrainRemote()
+{
+    // 先做一次普通读取，队列为空时不必对生产者争用的缓存行做读改写。
+    if (!m_remote.load(std::memory_order_relaxed)) {
+        return;
+    }
+    CoroTask *chain = m_remote.exchange(nullptr, std::memory_order_acquire);
+    CoroTask *first = nullptr;
+    CoroTask *last = chain;
+    while (chain) {
+        CoroTask *next = chain->m_readyNext;
+        chain->m_readyNext = first;
+        first = chain;
+        chain = next;
+    }
+    if (!first) {
+        return;
+    }
+    if (m_readyTail) {
+        m_readyTail->m_readyNext = first;
+    } else {
+        m_readyHead = first;
+    }
+    m_readyTail = last;
+}
+
+inline std::size_t CoroContext::Schedule()
+{
+    std::size_t resumed = 0;
+    for (;;) {
+        DrainRemote();
+        CoroTask *roundEnd = m_readyTail;
+        if (!roundEnd) {
+            return resumed;
+        }
+        CoroTask *task = nullptr;
+        do {
+            task = PopReady();
+            task->Resume();
+            ++resumed;
+        } while (task != roundEnd);
+    }
+}
+
+inline bool CoroContext::WaitRemote(int timeoutMs)
+{
+    m_sleeping.store(true);
+    bool woken = m_remote.load() != nullptr;
+    if (!woken) {
+        pollfd pfd { m_event, POLLIN, 0 };
+        woken = poll(&pfd, 1, timeoutMs) > 0;
+    }
+    m_sleeping.store(false, std::memory_order_relaxed);
+    // 清零计数。之后入队的批次看到 m_sleeping 为假就不再写，调用者接着 Schedule 会取走它们。
+    eventfd_t value;
+    eventfd_read(m_event, &value);
+    return woken;
+}
+
+inline void CoroContext::Run(std::stop_token stop)
+{
+    std::stop_callback wake { stop, [this]() { Notify(); } };
+    while (!stop.stop_requested()) {
+        if (Schedule() == 0) {
+            WaitRemote();
+        }
+    }
+}
@@ -0,0 +1,424 @@
+#pragma once
+
+#include <cassert>
+#include <concepts>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "CoroutineUcontext.hpp"
+
+// 拉取式的惰性流：任何有 value_type 和 std::optional<value_type> next() 的类型。
+// 算子只是包装上游的 next()，整条管道在模板实例化后内联成一个循环，
+// 没有中间容器，也没有每个算子一次的协程切换；只有 generator 这个源头需要切换上下文。
+
+template<typename S>
+concept stream = requires(S &s) {
+    typename std::remove_cvref_t<S>::value_type;
+    { s.next() } -> std::same_as<std::optional<typename std::remove_cvref_t<S>::value_type>>;
+};
+
+template<typename S>
+using stream_value_t = typename std::remove_cvref_t<S>::value_type;
+
+/// 让流可以用在范围 for 中。
+template<typename Derived>
+class stream_base {
+public:
+    struct sentinel {};
+
+    class iterator {
+    public:
+        using value_type = typename Derived::value_type;
+        using difference_type = std::ptrdiff_t;
+
+        explicit iterator(Derived *s)
+            : m_stream { s }
+            , m_current { s->next() }
+        { }
+
+        value_type &operator*()
+        {
+            return *m_current;
+        }
+
+        iterator &operator++()
+        {
+            m_current = m_stream->next();
+            return *this;
+        }
+
+        void operator++(int)
+        {
+            ++*this;
+        }
+
+        bool operator==(sentinel) const
+        {
+            return !m_current;
+        }
+
+    private:
+        Derived *m_stream;
+        std::optional<value_type> m_current;
+    };
+
+    iterator begin()
+    {
+        return iterator { static_cast<Derived *>(this) };
+    }
+
+    sentinel end()
+    {
+        return {};
+    }
+};
+
+/// 在 SimpleCoroutine 里运行生产者，攒够 batch 个值切回消费者一次。
+/**
+ * 生产者按需运行：消费者不拉取，生产者就停在 yield 处，内存占用只有 batch 个值，与输入大小无关。
+ * swapcontext 每次都有一次 sigprocmask 系统调用，逐个切换时开销远大于普通的函数调用，
+ * 所以默认按批切换；batch 为 1 时生产者严格地一次只领先一个值（副作用的时机更可预期）。
+ * 生产者抛出的异常在消费者的 next() 中重新抛出。
+ * 生产者没有运行完 generator 就被销毁时（比如下游 take 已经取够），
+ * yield 会抛出一个内部异常把协程栈展开，生产者里的局部对象（打开的文件等）照常析构。
+ * 因此生产者不能吞掉它不认识的异常：catch (...) 必须重新抛出。被吞掉之后再 yield 会再次抛出；
+ * 如果生产者仍然停在协程里，协程栈无法展开，析构时调用 std::terminate。
+ * @code
+ * generator<int> numbers { [](generator<int>::yielder &yield) {
+ *     for (int i = 0; i < 10; ++i) yield(i);
+ * } };
+ * for (int n : numbers | filter([](int n) { return n % 2; })) { ... }
+ * @endcode
+ */
+template<typename T>
+class generator : public stream_base<generator<T>> {
+    struct state;
+
+public:
+    using value_type = T;
+
+    class yielder {
+    public:
+        void operator()(T value)
+        {
+            if (m_state->cancelled) {
+                throw unwind {};
+            }
+            m_state->buffer.push_back(std::move(value));
+            if (m_state->buffer.size() < m_state->batch) {
+                return;
+            }
+            m_state->co.yield();
+            if (m_state->cancelled) {
+                throw unwind {};
+            }
+        }
+
+    private:
+        friend class generator;
+
+        explicit yielder(state *s)
+            : m_state { s }
+        { }
+
+        state *m_state;
+    };
+
+    explicit generator(std::function<void (yielder &)> body, std::size_t stackSize = 64 * 1024,
+                       std::size_t batch = 64)
+        : m_state { std::make_unique<state>(stackSize, batch, std::move(body)) }
+    { }
+
+    generator(generator &&) = default;
+    generator &operator=(generator &&) = default;
+
+    std::optional<T> next()
+    {
+        state &s = *m_state;
+        if (s.read == s.buffer.size()) {
+            s.buffer.clear();
+            s.read = 0;
+            s.started = true;
+            s.co();
+            if (s.buffer.empty()) {
+                // 异常之前 yield 的值已经全部交给了消费者。
+                if (s.error) {
+                    std::rethrow_exception(std::exchange(s.error, nullptr));
+                }
+                return std::nullopt;
+            }
+        }
+        return std::move(s.buffer[s.read++]);
+    }
+
+private:
+    struct unwind {};
+
+    // SimpleCoroutine 把 this 交给了 makecontext，不能移动，所以放在堆上。
+    struct state {
+        state(std::size_t stackSize, std::size_t batch, std::function<void (yielder &)> body)
+            : batch { batch }
+            , co { stackSize, [this, body = std::move(body)](SimpleCoroutine &) {
+                yielder y { this };
+                // 异常不能越过 makecontext 的入口，在协程内捕获后交给消费者。
+                try {
+                    body(y);
+                } catch (const unwind &) {
+                } catch (...) {
+                    error = std::current_exception();
+                }
+            } }
+        {
+            assert(batch >= 1u);
+            buffer.reserve(batch);
+        }
+
+        ~state()
+        {
+            if (started && !co) {
+                cancelled = true;
+                co();
+                // 协程还没有结束，说明生产者吞掉了取消。释放协程栈会跳过其中局部对象的析构。
+                if (!co) {
+                    std::terminate();
+                }
+            }
+        }
+
+        std::size_t batch;
+        SimpleCoroutine co;
+        std::vector<T> buffer;
+        std::size_t read { 0 };
+        std::exception_ptr error;
+        bool started { false };
+        bool cancelled { false };
+    };
+
+    std::unique_ptr<state> m_state;
+};
+
+/// 把已有的范围（容器、视图）当作流，不复制整个容器，逐个拷贝出元素。
+template<typename R>
+class from_view : public stream_base<from_view<R>> {
+public:
+    using value_type = std::remove_cvref_t<decltype(*std::begin(std::declval<R &>()))>;
+
+    explicit from_view(R &range)
+        : m_it { std::begin(range) }
+        , m_end { std::end(range) }
+    { }
+
+    std::optional<value_type> next()
+    {
+        if (m_it == m_end) {
+            return std::nullopt;
+        }
+        return *m_it++;
+    }
+
+private:
+    decltype(std::begin(std::declval<R &>())) m_it;
+    decltype(std::end(std::declval<R &>())) m_end;
+};
+
+template<typename R>
+from_view<R> from(R &range)
+{
+    return from_view<R> { range };
+}
+
+// 左值流以引用保存，右值流移动进来；S 可能是引用类型。
+
+template<typename S, typename F>
+class map_view : public stream_base<map_view<S, F>> {
+public:
+    using value_type = std::remove_cvref_t<std::invoke_result_t<F &, stream_value_t<S>>>;
+
+    map_view(S source, F f)
+        : m_source { std::forward<S>(source) }
+        , m_f { std::move(f) }
+    { }
+
+    std::optional<value_type> next()
+    {
+        if (auto v = m_source.next()) {
+            return std::invoke(m_f, std::move(*v));
+        }
+        return std::nullopt;
+    }
+
+private:
+    S m_source;
+    F m_f;
+};
+
+template<typename S, typename P>
+class filter_view : public stream_base<filter_view<S, P>> {
+public:
+    using value_type = stream_value_t<S>;
+
+    filter_view(S source, P pred)
+        : m_source { std::forward<S>(source) }
+        , m_pred { std::move(pred) }
+    { }
+
+    std::optional<value_type> next()
+    {
+        while (auto v = m_source.next()) {
+            if (std::invoke(m_pred, std::as_const(*v))) {
+                return v;
+            }
+        }
+        return std::nullopt;
+    }
+
+private:
+    S m_source;
+    P m_pred;
+};
+
+/// 取够 n 个之后不再拉取上游。
+/// 上游是 generator 时，生产者按批运行，可能已经领先最多 batch - 1 个值；
+/// 需要生产者严格地停在第 n 个值时，用 batch 为 1 的 generator。
+template<typename S>
+class take_view : public stream_base<take_view<S>> {
+public:
+    using value_type = stream_value_t<S>;
+
+    take_view(S source, std::size_t n)
+        : m_source { std::forward<S>(source) }
+        , m_remaining { n }
+    { }
+
+    std::optional<value_type> next()
+    {
+        if (m_remaining == 0) {
+            return std::nullopt;
+        }
+        --m_remaining;
+        return m_source.next();
+    }
+
+private:
+    S m_source;
+    std::size_t m_remaining;
+};
+
+/// 每 n 个元素打包成一批，最后一批可能不足 n 个。
+template<typename S>
+class chunk_view : public stream_base<chunk_view<S>> {
+public:
+    using value_type = std::vector<stream_value_t<S>>;
+
+    chunk_view(S source, std::size_t n)
+        : m_source { std::forward<S>(source) }
+        , m_size { n }
+    { }
+
+    std::optional<value_type> next()
+    {
+        value_type batch;
+        batch.reserve(m_size);
+        while (batch.size() < m_size) {
+            auto v = m_source.next();
+            if (!v) {
+                break;
+            }
+            batch.push_back(std::move(*v));
+        }
+        if (batch.empty()) {
+            return std::nullopt;
+        }
+        return batch;
+    }
+
+private:
+    S m_source;
+    std::size_t m_size;
+};
+
+/// 两个流逐个配对，较短的流结束时结束。
+template<typename S1, typename S2>
+class zip_view : public stream_base<zip_view<S1, S2>> {
+public:
+    using value_type = std::pair<stream_value_t<S1>, stream_value_t<S2>>;
+
+    zip_view(S1 first, S2 second)
+        : m_first { std::forward<S1>(first) }
+        , m_second { std::forward<S2>(second) }
+    { }
+
+    std::optional<value_type> next()
+    {
+        auto a = m_first.next();
+        if (!a) {
+            return std::nullopt;
+        }
+        auto b = m_second.next();
+        if (!b) {
+            return std::nullopt;
+        }
+        return value_type { std::move(*a), std::move(*b) };
+    }
+
+private:
+    S1 m_first;
+    S2 m_second;
+};
+
+template<stream S1, stream S2>
+zip_view<S1, S2> zip(S1 &&first, S2 &&second)
+{
+    return { std::forward<S1>(first), std::forward<S2>(second) };
+}
+
+// 管道语法：source | map(f) | filter(p) | take(n) | chunk(n)。
+// 算子先被包装成闭包，遇到 | 时才绑定上游。
+
+template<typename Fn>
+struct pipe_closure {
+    Fn make;
+};
+
+template<stream S, typename Fn>
+auto operator|(S &&source, pipe_closure<Fn> op)
+{
+    return op.make(std::forward<S>(source));
+}
+
+template<typename F>
+auto map(F f)
+{
+    return pipe_closure { [f = std::move(f)]<typename S>(S &&source) mutable {
+        return map_view<S, F> { std::forward<S>(source), std::move(f) };
+    } };
+}
+
+template<typename P>
+auto filter(P pred)
+{
+    return pipe_closure { [pred = std::move(pred)]<typename S>(S &&source) mutable {
+        return filter_view<S, P> { std::forward<S>(source), std::move(pred) };
+    } };
+}
+
+inline auto take(std::size_t n)
+{
+    return pipe_closure { [n]<typename S>(S &&source) {
+        return take_view<S> { std::forward<S>(source), n };
+    } };
+}
+
+inline auto chunk(std::size_t n)
+{
+    return pipe_closure { [n]<typename S>(S &&source) {
+        return chunk_view<S> { std::forward<S>(source), n };
+    } };
+}
@@ -0,0 +1,213 @@
+// 惰性流水线对比先物化到 std::vector 再逐步处理：耗时和堆内存峰值。
+//
+// g++ -std=c++20 -O2 GeneratorBenchmark.cpp -o generator_benchmark
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <malloc.h>
+#include <unistd.h>
+
+#include "Generator.hpp"
+
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+// 替换全局 operator new/delete，统计当前和峰值堆占用。
+static std::size_t g_heapBytes = 0;
+static std::size_t g_heapPeak = 0;
+
+void *operator new(std::size_t size)
+{
+    void *p = std::malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc {};
+    }
+    g_heapBytes += malloc_usable_size(p);
+    if (g_heapBytes > g_heapPeak) {
+        g_heapPeak = g_heapBytes;
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    if (p) {
+        g_heapBytes -= malloc_usable_size(p);
+        std::free(p);
+    }
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    operator delete(p);
+}
+
+constexpr int kLines = 1000000;
+constexpr std::size_t kBatch = 1024;
+
+/// 一行形如 "ts=123 level=ERROR service=svc7 latency_us=912 msg=..."。
+void WriteLog(const char *path)
+{
+    static const char *levels[] = { "INFO", "INFO", "INFO", "WARN", "ERROR" };
+    std::FILE *f = std::fopen(path, "w");
+    unsigned seed = 1;
+    for (int i = 0; i < kLines; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        std::fprintf(f, "ts=%d level=%s service=svc%u latency_us=%u msg=request handled by upstream\n",
+                     i, levels[(seed >> 16) % 5], (seed >> 8) % 16, (seed >> 4) % 2000);
+    }
+    std::fclose(f);
+}
+
+bool IsError(const std::string &line)
+{
+    return line.find("level=ERROR") != std::string::npos;
+}
+
+long ParseLatency(const std::string &line)
+{
+    return std::strtol(line.c_str() + line.find("latency_us=") + 11, nullptr, 10);
+}
+
+/// 按行读取的生产者，只持有一行的缓冲。
+generator<std::string> ReadLines(const char *path)
+{
+    return generator<std::string> { [path](generator<std::string>::yielder &yield) {
+        std::ifstream in { path };
+        std::string line;
+        while (std::getline(in, line)) {
+            yield(line);
+        }
+    } };
+}
+
+long LogMaterialized(const char *path)
+{
+    std::vector<std::string> lines;
+    {
+        std::ifstream in { path };
+        std::string line;
+        while (std::getline(in, line)) {
+            lines.push_back(line);
+        }
+    }
+    std::vector<std::string> errors;
+    for (auto &l : lines) {
+        if (IsError(l)) {
+            errors.push_back(l);
+        }
+    }
+    std::vector<long> latencies;
+    for (auto &l : errors) {
+        latencies.push_back(ParseLatency(l));
+    }
+    long slowBatches = 0;
+    for (std::size_t i = 0; i < latencies.size(); i += kBatch) {
+        long sum = 0;
+        const std::size_t end = std::min(latencies.size(), i + kBatch);
+        for (std::size_t j = i; j < end; ++j) {
+            sum += latencies[j];
+        }
+        slowBatches += sum / long(end - i) > 1000;
+    }
+    return slowBatches;
+}
+
+long LogStreamed(const char *path)
+{
+    long slowBatches = 0;
+    for (auto &batch : ReadLines(path) | filter(IsError) | map(ParseLatency) | chunk(kBatch)) {
+        long sum = 0;
+        for (long l : batch) {
+            sum += l;
+        }
+        slowBatches += sum / long(batch.size()) > 1000;
+    }
+    return slowBatches;
+}
+
+constexpr int kNumbers = 10000000;
+
+long NumbersMaterialized(const std::vector<int> &input)
+{
+    std::vector<long> squares;
+    for (int v : input) {
+        squares.push_back(long(v) * v);
+    }
+    std::vector<long> odd;
+    for (long v : squares) {
+        if (v & 1) {
+            odd.push_back(v);
+        }
+    }
+    long sum = 0;
+    for (long v : odd) {
+        sum += v;
+    }
+    return sum;
+}
+
+long NumbersFused(const std::vector<int> &input)
+{
+    long sum = 0;
+    for (long v : from(input) | map([](int v) { return long(v) * v; }) | filter([](long v) { return v & 1; })) {
+        sum += v;
+    }
+    return sum;
+}
+
+long NumbersGenerator(std::size_t batch)
+{
+    generator<int> source { [](generator<int>::yielder &yield) {
+        for (int i = 0; i < kNumbers; ++i) {
+            yield(i % 1000);
+        }
+    }, 64 * 1024, batch };
+    long sum = 0;
+    for (long v : source | map([](int v) { return long(v) * v; }) | filter([](long v) { return v & 1; })) {
+        sum += v;
+    }
+    return sum;
+}
+
+template<typename Fn>
+void Run(const char *name, Fn &&fn)
+{
+    const std::size_t base = g_heapBytes;
+    g_heapPeak = base;
+    const auto start = std::chrono::steady_clock::now();
+    const long result = fn();
+    const auto ms = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() / 1000.0;
+    std::printf("%-28s %10.1f ms %12.2f MiB peak heap  (%ld)\n", name, ms,
+                double(g_heapPeak - base) / (1024 * 1024), result);
+}
+
+int main(int argc, const char *argv[])
+{
+    char path[] = "/tmp/generator_log_XXXXXX";
+    close(mkstemp(path));
+    WriteLog(path);
+
+    Run("log: materialized", [&]() { return LogMaterialized(path); });
+    Run("log: generator pipeline", [&]() { return LogStreamed(path); });
+    unlink(path);
+
+    std::vector<int> input(kNumbers);
+    for (int i = 0; i < kNumbers; ++i) {
+        input[i] = i % 1000;
+    }
+    Run("numbers: materialized", [&]() { return NumbersMaterialized(input); });
+    Run("numbers: fused from(vector)", [&]() { return NumbersFused(input); });
+    // 每次切换是两次 swapcontext（glibc 里各含一次 sigprocmask 系统调用）。
+    // 源头本身很廉价时，逐个切换的开销占主导，按批切换才能接近普通循环。
+    Run("numbers: generator, batch 1", [&]() { return NumbersGenerator(1); });
+    Run("numbers: generator, batch 64", [&]() { return NumbersGenerator(64); });
+    return 0;
+}
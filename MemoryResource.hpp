@@ -0,0 +1,282 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+
+// 两种 std::pmr::memory_resource 实现：
+// - MonotonicArena：请求级别的单调分配器，Reset() 一次性"释放"请求内所有对象，
+//   已申请的内存块保留下来给下一个请求复用，稳定状态下不再调用 malloc。
+// - LockFreePoolResource：按尺寸分级的定长块池，各级空闲链表是无锁栈，
+//   可被多个线程同时使用。
+
+/** 单调分配器，不是线程安全的，一个请求（或一个工作线程）持有一个。 */
+class MonotonicArena : public std::pmr::memory_resource {
+public:
+    explicit MonotonicArena(std::size_t chunkSize = 64 * 1024,
+                            std::pmr::memory_resource *upstream = std::pmr::new_delete_resource())
+        : m_chunkSize { chunkSize }
+        , m_upstream { upstream }
+    { }
+
+    MonotonicArena(const MonotonicArena &) = delete;
+    MonotonicArena &operator=(const MonotonicArena &) = delete;
+
+    ~MonotonicArena() override
+    {
+        Release();
+    }
+
+    /// 回到第一个内存块重新分配，调用者需保证之前分配的对象都已析构或不再使用。
+    void Reset() noexcept
+    {
+        m_current = m_head;
+        Rewind();
+    }
+
+    /// 把所有内存块还给上游。
+    void Release() noexcept
+    {
+        while (m_head) {
+            Chunk *next = m_head->next;
+            m_upstream->deallocate(m_head, m_head->size, alignof(Chunk));
+            m_head = next;
+        }
+        m_current = nullptr;
+        m_cur = m_end = nullptr;
+    }
+
+    /// 向上游申请过的字节数，用来观察稳定状态下是否还在增长。
+    std::size_t Reserved() const noexcept
+    {
+        std::size_t total = 0;
+        for (Chunk *c = m_head; c; c = c->next) {
+            total += c->size;
+        }
+        return total;
+    }
+
+private:
+    struct alignas(std::max_align_t) Chunk {
+        Chunk *next;
+        std::size_t size;
+    };
+
+    void Rewind() noexcept
+    {
+        m_cur = m_current ? reinterpret_cast<std::byte *>(m_current + 1) : nullptr;
+        m_end = m_current ? reinterpret_cast<std::byte *>(m_current) + m_current->size : nullptr;
+    }
+
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        for (;;) {
+            if (m_cur) {
+                auto addr = reinterpret_cast<std::uintptr_t>(m_cur);
+                auto aligned = (addr + alignment - 1) & ~(std::uintptr_t { alignment } - 1);
+                if (aligned + bytes <= reinterpret_cast<std::uintptr_t>(m_end)) {
+                    m_cur = reinterpret_cast<std::byte *>(aligned + bytes);
+                    return reinterpret_cast<void *>(aligned);
+                }
+            }
+            // 当前块用完：先复用 Reset() 之前申请过的后续块，不够再向上游申请。
+            if (m_current && m_current->next && FitsIn(m_current->next, bytes, alignment)) {
+                m_current = m_current->next;
+                Rewind();
+                continue;
+            }
+            InsertChunk(bytes, alignment);
+        }
+    }
+
+    void do_deallocate(void *, std::size_t, std::size_t) override
+    {
+        // 单调分配器不回收单个对象，内存在 Reset()/Release() 时整体回收。
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+
+    static bool FitsIn(const Chunk *chunk, std::size_t bytes, std::size_t alignment)
+    {
+        return chunk->size >= sizeof(Chunk) + bytes + alignment;
+    }
+
+    void InsertChunk(std::size_t bytes, std::size_t alignment)
+    {
+        std::size_t size = m_chunkSize;
+        while (size < sizeof(Chunk) + bytes + alignment) {
+            size *= 2;
+        }
+        auto chunk = static_cast<Chunk *>(m_upstream->allocate(size, alignof(Chunk)));
+        chunk->size = size;
+        if (m_current) {
+            chunk->next = m_current->next;
+            m_current->next = chunk;
+        } else {
+            chunk->next = m_head;
+            m_head = chunk;
+        }
+        m_current = chunk;
+        Rewind();
+    }
+
+private:
+    std::size_t m_chunkSize;
+    std::pmr::memory_resource *m_upstream;
+    Chunk *m_head { nullptr };
+    Chunk *m_current { nullptr };
+    std::byte *m_cur { nullptr };
+    std::byte *m_end { nullptr };
+};
+
+/** 线程安全的定长块池：16..1024 字节按 2 的幂分级，更大的请求直接转给上游。 */
+class LockFreePoolResource : public std::pmr::memory_resource {
+public:
+    static constexpr std::size_t kMinBlock = 16;
+    static constexpr std::size_t kMaxBlock = 1024;
+    static constexpr std::size_t kClasses = std::countr_zero(kMaxBlock) - std::countr_zero(kMinBlock) + 1;
+
+    explicit LockFreePoolResource(std::pmr::memory_resource *upstream = std::pmr::new_delete_resource(),
+                                  std::size_t chunkSize = 64 * 1024)
+        : m_upstream { upstream }
+        , m_chunkSize { chunkSize }
+    {
+        assert(chunkSize >= kChunkHeader + kMaxBlock);
+    }
+
+    LockFreePoolResource(const LockFreePoolResource &) = delete;
+    LockFreePoolResource &operator=(const LockFreePoolResource &) = delete;
+
+    ~LockFreePoolResource() override
+    {
+        Chunk *chunk = m_chunks.load(std::memory_order_acquire);
+        while (chunk) {
+            Chunk *next = chunk->next;
+            m_upstream->deallocate(chunk, m_chunkSize, kChunkAlign);
+            chunk = next;
+        }
+    }
+
+private:
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+
+    struct Chunk {
+        Chunk *next;
+    };
+
+    // 块在 chunk 内按自身尺寸对齐，最大对齐到 kChunkAlign。
+    static constexpr std::size_t kChunkAlign = 64;
+    static constexpr std::size_t kChunkHeader = kChunkAlign;
+
+    // 空闲链表头把 ABA 计数塞进指针高 16 位（x86-64/AArch64 用户态地址只有 48 位），
+    // 单个 64 位 CAS 即可，不依赖 cmpxchg16b。
+    static constexpr unsigned kTagShift = 48;
+    static constexpr std::uint64_t kPtrMask = (std::uint64_t { 1 } << kTagShift) - 1;
+
+    static FreeBlock *PtrOf(std::uint64_t head)
+    {
+        return reinterpret_cast<FreeBlock *>(head & kPtrMask);
+    }
+
+    static std::uint64_t Pack(FreeBlock *p, std::uint64_t oldHead)
+    {
+        return reinterpret_cast<std::uint64_t>(p) | ((oldHead >> kTagShift) + 1) << kTagShift;
+    }
+
+    /// 返回尺寸级别，放不进池子的返回 kClasses。
+    static std::size_t ClassOf(std::size_t bytes, std::size_t alignment)
+    {
+        const std::size_t size = std::bit_ceil(std::max({ bytes, alignment, kMinBlock }));
+        if (size > kMaxBlock || alignment > kChunkAlign) {
+            return kClasses;
+        }
+        return std::countr_zero(size) - std::countr_zero(kMinBlock);
+    }
+
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        const std::size_t cls = ClassOf(bytes, alignment);
+        if (cls == kClasses) {
+            return m_upstream->allocate(bytes, alignment);
+        }
+
+        std::atomic<std::uint64_t> &head = m_heads[cls];
+        std::uint64_t old = head.load(std::memory_order_acquire);
+        while (FreeBlock *block = PtrOf(old)) {
+            // block 可能刚被别的线程弹出并写入了用户数据，读到的 next 是垃圾值；
+            // 但 chunk 在池子析构前不会归还，读本身是安全的，计数不同会让 CAS 失败。
+            FreeBlock *next = block->next;
+            if (head.compare_exchange_weak(old, Pack(next, old),
+                                           std::memory_order_acquire, std::memory_order_acquire)) {
+                return block;
+            }
+        }
+        return Refill(cls);
+    }
+
+    void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override
+    {
+        const std::size_t cls = ClassOf(bytes, alignment);
+        if (cls == kClasses) {
+            m_upstream->deallocate(p, bytes, alignment);
+            return;
+        }
+        auto block = static_cast<FreeBlock *>(p);
+        Push(cls, block, block);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+
+    void Push(std::size_t cls, FreeBlock *first, FreeBlock *last)
+    {
+        std::atomic<std::uint64_t> &head = m_heads[cls];
+        std::uint64_t old = head.load(std::memory_order_relaxed);
+        do {
+            last->next = PtrOf(old);
+        } while (!head.compare_exchange_weak(old, Pack(first, old),
+                                             std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    /// 空闲链表为空：向上游申请一个 chunk，切成定长块，留一块返回，其余整串压栈。
+    void *Refill(std::size_t cls)
+    {
+        const std::size_t blockSize = kMinBlock << cls;
+        auto base = static_cast<std::byte *>(m_upstream->allocate(m_chunkSize, kChunkAlign));
+
+        auto chunk = reinterpret_cast<Chunk *>(base);
+        chunk->next = m_chunks.load(std::memory_order_relaxed);
+        while (!m_chunks.compare_exchange_weak(chunk->next, chunk,
+                                               std::memory_order_release, std::memory_order_relaxed)) {
+        }
+
+        std::byte *first = base + kChunkHeader;
+        const std::size_t count = (m_chunkSize - kChunkHeader) / blockSize;
+        if (count > 1) {
+            for (std::size_t i = 1; i + 1 < count; ++i) {
+                reinterpret_cast<FreeBlock *>(first + i * blockSize)->next =
+                    reinterpret_cast<FreeBlock *>(first + (i + 1) * blockSize);
+            }
+            Push(cls, reinterpret_cast<FreeBlock *>(first + blockSize),
+                 reinterpret_cast<FreeBlock *>(first + (count - 1) * blockSize));
+        }
+        return first;
+    }
+
+private:
+    std::pmr::memory_resource *m_upstream;
+    std::size_t m_chunkSize;
+    std::atomic<std::uint64_t> m_heads[kClasses] {};
+    std::atomic<Chunk *> m_chunks { nullptr };
+};
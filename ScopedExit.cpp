@@ -1,32 +1,68 @@
-#include <concepts>
+#include <chrono>
 #include <functional>
 #include <iostream>
+#include <stdexcept>
 
-#define SCOPED_EXIT(f)  SCOPED_EXIT_UNIQ(f, __LINE__)
-#define SCOPED_EXIT_UNIQ(f, l)  SCOPED_EXIT_UNIQ_EXPAND(f, l)
-#define SCOPED_EXIT_UNIQ_EXPAND(f, l)  ScopedExit CONCAT_NAME(scopedExit, l) { f }
-#define CONCAT_NAME(n1, n2)  n1 ## n2
+#include "ScopedExit.hpp"
 
-template<std::invocable Callable>
-class ScopedExit {
-public:
-    ScopedExit(Callable f)
-        : m_f { std::move(f) }
-    { }
+void test3()
+{
+    std::cout << "test3" << std::endl;
+}
 
-    // https://en.cppreference.com/w/cpp/language/as_if
-    ~ScopedExit() noexcept(std::is_nothrow_invocable_v<Callable>)
-    {
-        m_f();
+// 对照组：同一段回滚逻辑，分别手写、用 guard、用 std::function 的 guard。
+// 对比生成代码：
+//   g++ -std=c++20 -O2 -S ScopedExit.cpp -o - | c++filt
+// RollbackHandwritten 和 RollbackGuard 的函数体是同样的指令（至多寄存器分配不同），
+// RollbackStdFunction 会多出 std::function 的构造、间接调用和析构。
+[[gnu::noinline]] int RollbackHandwritten(int &balance, int amount)
+{
+    const int saved = balance;
+    balance -= amount;
+    if (balance < 0) {
+        balance = saved;
+        return -1;
     }
+    return balance;
+}
 
-private:
-    Callable m_f;
-};
+[[gnu::noinline]] int RollbackGuard(int &balance, int amount)
+{
+    const int saved = balance;
+    DismissibleScopedExit rollback { [&]() noexcept { balance = saved; } };
+    balance -= amount;
+    if (balance < 0) {
+        return -1;
+    }
+    rollback.Release();
+    return balance;
+}
 
-void test3()
+[[gnu::noinline]] int RollbackStdFunction(int &balance, int amount)
 {
-    std::cout << "test3" << std::endl;
+    const int saved = balance;
+    DismissibleScopedExit<std::function<void()>> rollback { [&]() noexcept { balance = saved; } };
+    balance -= amount;
+    if (balance < 0) {
+        return -1;
+    }
+    rollback.Release();
+    return balance;
+}
+
+template<typename Fn>
+void Bench(const char *name, Fn fn)
+{
+    constexpr int kIterations = 10000000;
+    int balance = 0;
+    long long sum = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kIterations; ++i) {
+        balance = i & 1;
+        sum += fn(balance, 1);
+    }
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << name << ": " << double(ns) / kIterations << " ns/iter (" << sum << ")" << std::endl;
 }
 
 int main(int argc, const char *argv[])
@@ -36,12 +72,28 @@ int main(int argc, const char *argv[])
         std::cout << "delete ptr, *ptr=" << *ptrInt << std::endl;
         delete ptrInt;
     });
-    
+
     std::function<void()> test2 = []() { std::cout << "test2" << std::endl; };
     SCOPED_EXIT(test2);
-    
+
     SCOPED_EXIT(test3);
-    
+
+    try {
+        SCOPED_SUCCESS([]() { std::cout << "commit (not printed)" << std::endl; });
+        SCOPED_FAIL([]() { std::cout << "rollback" << std::endl; });
+        throw std::runtime_error("boom");
+    } catch (const std::exception &e) {
+        std::cout << "caught: " << e.what() << std::endl;
+    }
+
+    {
+        SCOPED_SUCCESS([]() { std::cout << "commit" << std::endl; });
+        SCOPED_FAIL([]() { std::cout << "rollback (not printed)" << std::endl; });
+    }
+
+    Bench("handwritten", RollbackHandwritten);
+    Bench("guard", RollbackGuard);
+    Bench("std::function guard", RollbackStdFunction);
+
     return 0;
 }
-
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <concepts>
+#include <exception>
+#include <type_traits>
+
+#define SCOPED_EXIT(f)  SCOPED_EXIT_UNIQ(ScopedExit, f, __LINE__)
+#define SCOPED_SUCCESS(f)  SCOPED_EXIT_UNIQ(ScopedSuccess, f, __LINE__)
+#define SCOPED_FAIL(f)  SCOPED_EXIT_UNIQ(ScopedFail, f, __LINE__)
+#define SCOPED_EXIT_UNIQ(g, f, l)  SCOPED_EXIT_UNIQ_EXPAND(g, f, l)
+#define SCOPED_EXIT_UNIQ_EXPAND(g, f, l)  g CONCAT_NAME(scopedExit, l) { f }
+#define CONCAT_NAME(n1, n2)  n1 ## n2
+
+// 所有 guard 都按值保存 Callable，不做类型擦除：传 lambda 时整个 guard 就是
+// lambda 的捕获，析构被内联后与手写的清理代码一致。不要传 std::function，
+// 那样每个 guard 都可能有一次堆分配和一次间接调用。
+
+/// 总是在离开作用域时调用。
+template<std::invocable Callable>
+class ScopedExit {
+public:
+    ScopedExit(Callable f)
+        : m_f { std::move(f) }
+    { }
+
+    ScopedExit(const ScopedExit &) = delete;
+    ScopedExit &operator=(const ScopedExit &) = delete;
+
+    // https://en.cppreference.com/w/cpp/language/as_if
+    ~ScopedExit() noexcept(std::is_nothrow_invocable_v<Callable>)
+    {
+        m_f();
+    }
+
+private:
+    Callable m_f;
+};
+
+/// 只在正常离开作用域（没有新的异常在传播）时调用，比如提交事务。
+template<std::invocable Callable>
+class ScopedSuccess {
+public:
+    ScopedSuccess(Callable f)
+        : m_f { std::move(f) }
+    { }
+
+    ScopedSuccess(const ScopedSuccess &) = delete;
+    ScopedSuccess &operator=(const ScopedSuccess &) = delete;
+
+    // 正常路径上允许 m_f 抛出异常。
+    ~ScopedSuccess() noexcept(std::is_nothrow_invocable_v<Callable>)
+    {
+        // 与构造时比较，而不是 std::uncaught_exception()：guard 可能本身
+        // 就构造在另一个异常的栈回退过程中（比如某个析构函数里）。
+        if (std::uncaught_exceptions() <= m_uncaught) {
+            m_f();
+        }
+    }
+
+private:
+    Callable m_f;
+    int m_uncaught { std::uncaught_exceptions() };
+};
+
+/// 只在因异常离开作用域时调用，比如回滚。
+template<std::invocable Callable>
+class ScopedFail {
+public:
+    ScopedFail(Callable f)
+        : m_f { std::move(f) }
+    { }
+
+    ScopedFail(const ScopedFail &) = delete;
+    ScopedFail &operator=(const ScopedFail &) = delete;
+
+    // 栈回退过程中再抛出只会 std::terminate，所以这里总是 noexcept。
+    ~ScopedFail() noexcept
+    {
+        if (std::uncaught_exceptions() > m_uncaught) {
+            m_f();
+        }
+    }
+
+private:
+    Callable m_f;
+    int m_uncaught { std::uncaught_exceptions() };
+};
+
+/// 可以在离开作用域前 Release() 取消的 ScopedExit，比如"提交后就不需要回滚"。
+template<std::invocable Callable>
+class DismissibleScopedExit {
+public:
+    DismissibleScopedExit(Callable f)
+        : m_f { std::move(f) }
+    { }
+
+    DismissibleScopedExit(const DismissibleScopedExit &) = delete;
+    DismissibleScopedExit &operator=(const DismissibleScopedExit &) = delete;
+
+    ~DismissibleScopedExit() noexcept(std::is_nothrow_invocable_v<Callable>)
+    {
+        if (m_active) {
+            m_f();
+        }
+    }
+
+    void Release() noexcept
+    {
+        m_active = false;
+    }
+
+private:
+    Callable m_f;
+    bool m_active { true };
+};
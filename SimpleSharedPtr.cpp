@@ -1,138 +1,64 @@
-#include <atomic>
+#include <cstdio>
 #include <iostream>
+#include <vector>
 
-template<typename T>
-class SimpleSharedPtr {
-public:
-    SimpleSharedPtr() = default;
-    SimpleSharedPtr(const SimpleSharedPtr<T>& obj);
-    SimpleSharedPtr(SimpleSharedPtr<T>&& obj);
-    SimpleSharedPtr(T* ptr);
-    ~SimpleSharedPtr();
-
-    T *Get() const;
-    void Reset(T* ptr);
-    SimpleSharedPtr<T>& operator=(const SimpleSharedPtr<T>& obj);
-    SimpleSharedPtr<T>& operator=(SimpleSharedPtr<T>&& obj);
-
-private:
-    class RefCounterModel {
-    public:
-        RefCounterModel() = default;
-        RefCounterModel(T* ptr);
+#include "SimpleSharedPtr.hpp"
 
-        template<typename... Ts>
-        RefCounterModel(Ts&&... ts);
+namespace {
 
-        void ShareOwnership();
-        bool ReleaseOwnership();
-        T* Get() const;
-
-    private:
-        std::atomic<int> m_counter { 1 };
-        T *m_obj { nullptr };
-    };
-
-    mutable RefCounterModel *m_pRefCntObj { nullptr };
+struct Connection {
+    int fd = -1;
 };
 
-template<typename T, typename... Ts>
-SimpleSharedPtr<T> MakeSharedPtr(Ts... ts)
-{
-    T* obj = new T(ts...);
-    return SimpleSharedPtr<T>(obj);
-}
+/// 对象用完回到池里而不是释放，下次 Acquire 直接复用。
+class ConnectionPool {
+public:
+    /// 有状态的 deleter：控制块里多一个指针。
+    struct Return {
+        ConnectionPool *pool;
 
-/* **/
+        void operator()(Connection *conn) const
+        {
+            pool->m_free.push_back(conn);
+        }
+    };
 
-template<typename T>
-SimpleSharedPtr<T>::SimpleSharedPtr(const SimpleSharedPtr<T>& obj)
-{
-    m_pRefCntObj = obj.m_pRefCntObj;
-    if (m_pRefCntObj) {
-        m_pRefCntObj->ShareOwnership();
+    ~ConnectionPool()
+    {
+        for (Connection *conn : m_free) {
+            delete conn;
+        }
     }
-}
-
-template<typename T>
-SimpleSharedPtr<T>::SimpleSharedPtr(SimpleSharedPtr<T>&& obj)
-{
-    m_pRefCntObj = obj.m_pRefCntObj;
-    obj.m_pRefCntObj = nullptr;
-}
 
-template<typename T>
-SimpleSharedPtr<T>::SimpleSharedPtr(T* ptr)
-{
-    m_pRefCntObj = new RefCounterModel(ptr);
-}
-
-template<typename T>
-SimpleSharedPtr<T>::~SimpleSharedPtr()
-{
-    if (m_pRefCntObj && m_pRefCntObj->ReleaseOwnership()) {
-        delete m_pRefCntObj;
-        m_pRefCntObj = nullptr;
-        std::cout << "Release ref-cnt obj" << std::endl;
+    SimpleSharedPtr<Connection> Acquire()
+    {
+        Connection *conn = nullptr;
+        if (m_free.empty()) {
+            conn = new Connection { static_cast<int>(++m_created) };
+        } else {
+            conn = m_free.back();
+            m_free.pop_back();
+        }
+        return SimpleSharedPtr<Connection>(conn, Return { this });
     }
-}
 
-template<typename T>
-T* SimpleSharedPtr<T>::Get() const
-{
-    return m_pRefCntObj ? m_pRefCntObj->Get() : nullptr;
-}
+    std::size_t Created() const { return m_created; }
+    std::size_t Idle() const { return m_free.size(); }
 
-template<typename T>
-void SimpleSharedPtr<T>::Reset(T* ptr)
-{
-    this->~SimpleSharedPtr();
-    m_pRefCntObj = new RefCounterModel(ptr);
-}
-
-
-template<typename T>
-SimpleSharedPtr<T>::RefCounterModel::RefCounterModel(T* ptr)
-{
-    m_counter = 1;
-    m_obj = ptr;
-}
-
-template<typename T>
-template<typename... Ts>
-SimpleSharedPtr<T>::RefCounterModel::RefCounterModel(Ts&&... ts)
-{
-    m_counter = 1;
-    m_obj = new T(ts...);
-}
-
-template<typename T>
-void SimpleSharedPtr<T>::RefCounterModel::ShareOwnership()
-{
-    if (m_obj) {
-        m_counter++;
-    }
-}
-
-template<typename T>
-T* SimpleSharedPtr<T>::RefCounterModel::Get() const
-{
-    return m_obj;
-}
+private:
+    std::vector<Connection *> m_free;
+    std::size_t m_created = 0;
+};
 
-template<typename T>
-bool SimpleSharedPtr<T>::RefCounterModel::ReleaseOwnership()
-{
-    if (m_obj) {
-        m_counter--;
-        if (m_counter == 0) {
-            delete m_obj;
-            return true;
-        }
+/// 无状态的 deleter：空基类优化后不占控制块的空间。
+struct FileCloser {
+    void operator()(std::FILE *file) const
+    {
+        std::fclose(file);
     }
+};
 
-    return false;
-}
+} // namespace
 
 int main(int argc, const char* argv)
 {
@@ -162,6 +88,25 @@ int main(int argc, const char* argv)
     std::cout << "p:" << obj1.Get() << " " << obj3.Get() << std::endl;
     SimpleSharedPtr<int> obj4 { (obj2) };
     }
+
+    {
+    ConnectionPool pool;
+    {
+    SimpleSharedPtr<Connection> a = pool.Acquire();
+    SimpleSharedPtr<Connection> b = a;
+    SimpleSharedPtr<Connection> c = pool.Acquire();
+    std::cout << "fds: " << a.Get()->fd << " " << c.Get()->fd << " idle: " << pool.Idle() << std::endl;
+    }
+    // 最后一个拥有者释放时连接回到池里，再次获取时复用，不新建。
+    SimpleSharedPtr<Connection> d = pool.Acquire();
+    std::cout << "idle: " << pool.Idle() << " created: " << pool.Created() << " reused fd: " << d.Get()->fd << std::endl;
+    }
+
+    {
+    SimpleSharedPtr<std::FILE> file { std::tmpfile(), FileCloser {} };
+    std::fputs("closed by FileCloser\n", file.Get());
+    SimpleSharedPtr<std::FILE> other { file };
+    }
     return 0;
 }
 
@@ -0,0 +1,297 @@
+#pragma once
+
+#include <atomic>
+#include <concepts>
+#include <iostream>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/// base_from_member.cpp 里 my_member_from_base 的变体：T 是空类时直接继承 T，
+/// 借助空基类优化不占空间；否则和 my_member_from_base 一样持有一个成员。
+template<typename T, int id = 0, bool = std::is_empty_v<T> && !std::is_final_v<T>>
+struct CompressedMember {
+    T member;
+
+    template<typename... Ts>
+    explicit CompressedMember(Ts&&... ts)
+        : member(std::forward<Ts>(ts)...)
+    { }
+
+    T &Get() { return member; }
+};
+
+template<typename T, int id>
+struct CompressedMember<T, id, true> : private T {
+    template<typename... Ts>
+    explicit CompressedMember(Ts&&... ts)
+        : T(std::forward<Ts>(ts)...)
+    { }
+
+    T &Get() { return *this; }
+};
+
+/// 把对象还给分配它的 memory_resource。
+template<typename T>
+struct PmrDeleter {
+    std::pmr::memory_resource *resource;
+
+    void operator()(T *p) const
+    {
+        std::pmr::polymorphic_allocator<T>{ resource }.delete_object(p);
+    }
+};
+
+template<typename T>
+class SimpleSharedPtr {
+public:
+    SimpleSharedPtr() = default;
+    SimpleSharedPtr(const SimpleSharedPtr<T>& obj);
+    SimpleSharedPtr(SimpleSharedPtr<T>&& obj);
+    SimpleSharedPtr(T* ptr);
+    /// 控制块从 resource 分配，对象本身仍由 delete 释放。
+    SimpleSharedPtr(T* ptr, std::pmr::memory_resource *resource);
+    /// 最后一个拥有者释放时调用 deleter(ptr)，比如把对象还给对象池。
+    /**
+     * 控制块用 alloc（按控制块类型 rebind）分配。无状态的 deleter 和 alloc
+     * 不增加控制块的大小。分配控制块失败时先调用 deleter(ptr) 再抛出。
+     */
+    template<typename D, typename A = std::allocator<T>>
+        requires std::invocable<D &, T *>
+    SimpleSharedPtr(T* ptr, D deleter, A alloc = A {});
+    ~SimpleSharedPtr();
+
+    T *Get() const;
+    void Reset(T* ptr);
+    SimpleSharedPtr<T>& operator=(const SimpleSharedPtr<T>& obj);
+    SimpleSharedPtr<T>& operator=(SimpleSharedPtr<T>&& obj);
+
+private:
+    /// 控制块的公共部分，拷贝路径只用到它；释放对象和控制块的方式由子类决定。
+    class RefCounterModel {
+    public:
+        explicit RefCounterModel(T* ptr);
+
+        void ShareOwnership();
+        bool ReleaseOwnership();
+        T* Get() const;
+
+        /// 释放控制块本身，只在 ReleaseOwnership() 返回 true 之后调用。
+        virtual void Destroy() noexcept = 0;
+
+    protected:
+        ~RefCounterModel() = default;
+
+        /// 释放对象。
+        virtual void Dispose() noexcept = 0;
+
+        std::atomic<int> m_counter { 1 };
+        T *m_obj { nullptr };
+    };
+
+    /// deleter 和 allocator 作为私有基类先于 RefCounterModel 构造（base-from-member），
+    /// 空类型经由 CompressedMember 不占空间。
+    template<typename D, typename A>
+    class RefCounterImpl final
+        : private CompressedMember<D, 0>
+        , private CompressedMember<typename std::allocator_traits<A>::template rebind_alloc<RefCounterImpl<D, A>>, 1>
+        , public RefCounterModel {
+    public:
+        using Alloc = typename std::allocator_traits<A>::template rebind_alloc<RefCounterImpl>;
+
+        RefCounterImpl(T* ptr, D deleter, Alloc alloc);
+
+        void Destroy() noexcept override;
+
+    private:
+        using DeleterBase = CompressedMember<D, 0>;
+        using AllocBase = CompressedMember<Alloc, 1>;
+
+        void Dispose() noexcept override;
+    };
+
+    template<typename D, typename A>
+    static RefCounterModel *CreateRefCntObj(T* ptr, D deleter, A alloc);
+    static void DestroyRefCntObj(RefCounterModel *pRefCntObj);
+
+    mutable RefCounterModel *m_pRefCntObj { nullptr };
+};
+
+template<typename T, typename... Ts>
+SimpleSharedPtr<T> MakeSharedPtr(Ts... ts)
+{
+    T* obj = new T(ts...);
+    return SimpleSharedPtr<T>(obj);
+}
+
+/// 对象和控制块都从 resource 分配，配合请求级的 arena 可以做到整个请求零 malloc。
+template<typename T, typename... Ts>
+SimpleSharedPtr<T> AllocateSharedPtr(std::pmr::memory_resource *resource, Ts&&... ts)
+{
+    T* obj = std::pmr::polymorphic_allocator<T>{ resource }.template new_object<T>(std::forward<Ts>(ts)...);
+    return SimpleSharedPtr<T>(obj, PmrDeleter<T>{ resource }, std::pmr::polymorphic_allocator<T>{ resource });
+}
+
+/* **/
+
+template<typename T>
+SimpleSharedPtr<T>::SimpleSharedPtr(const SimpleSharedPtr<T>& obj)
+{
+    m_pRefCntObj = obj.m_pRefCntObj;
+    if (m_pRefCntObj) {
+        m_pRefCntObj->ShareOwnership();
+    }
+}
+
+template<typename T>
+SimpleSharedPtr<T>::SimpleSharedPtr(SimpleSharedPtr<T>&& obj)
+{
+    m_pRefCntObj = obj.m_pRefCntObj;
+    obj.m_pRefCntObj = nullptr;
+}
+
+template<typename T>
+SimpleSharedPtr<T>::SimpleSharedPtr(T* ptr)
+    : SimpleSharedPtr(ptr, std::default_delete<T> {})
+{
+}
+
+template<typename T>
+SimpleSharedPtr<T>::SimpleSharedPtr(T* ptr, std::pmr::memory_resource *resource)
+    : SimpleSharedPtr(ptr, std::default_delete<T> {}, std::pmr::polymorphic_allocator<T>{ resource })
+{
+}
+
+template<typename T>
+template<typename D, typename A>
+    requires std::invocable<D &, T *>
+SimpleSharedPtr<T>::SimpleSharedPtr(T* ptr, D deleter, A alloc)
+{
+    m_pRefCntObj = CreateRefCntObj(ptr, std::move(deleter), std::move(alloc));
+}
+
+template<typename T>
+SimpleSharedPtr<T>::~SimpleSharedPtr()
+{
+    if (m_pRefCntObj && m_pRefCntObj->ReleaseOwnership()) {
+        DestroyRefCntObj(m_pRefCntObj);
+        m_pRefCntObj = nullptr;
+#ifndef NDEBUG
+        std::cout << "Release ref-cnt obj" << std::endl;
+#endif
+    }
+}
+
+template<typename T>
+T* SimpleSharedPtr<T>::Get() const
+{
+    return m_pRefCntObj ? m_pRefCntObj->Get() : nullptr;
+}
+
+template<typename T>
+SimpleSharedPtr<T>& SimpleSharedPtr<T>::operator=(const SimpleSharedPtr<T>& obj)
+{
+    SimpleSharedPtr<T> tmp { obj };
+    std::swap(m_pRefCntObj, tmp.m_pRefCntObj);
+    return *this;
+}
+
+template<typename T>
+SimpleSharedPtr<T>& SimpleSharedPtr<T>::operator=(SimpleSharedPtr<T>&& obj)
+{
+    SimpleSharedPtr<T> tmp { std::move(obj) };
+    std::swap(m_pRefCntObj, tmp.m_pRefCntObj);
+    return *this;
+}
+
+template<typename T>
+void SimpleSharedPtr<T>::Reset(T* ptr)
+{
+    SimpleSharedPtr<T> tmp { ptr };
+    std::swap(m_pRefCntObj, tmp.m_pRefCntObj);
+}
+
+template<typename T>
+template<typename D, typename A>
+typename SimpleSharedPtr<T>::RefCounterModel *SimpleSharedPtr<T>::CreateRefCntObj(T* ptr, D deleter, A alloc)
+{
+    using Impl = RefCounterImpl<D, A>;
+    using Traits = std::allocator_traits<typename Impl::Alloc>;
+    static_assert(!std::is_empty_v<D> || !std::is_empty_v<typename Impl::Alloc> || sizeof(Impl) == sizeof(RefCounterModel),
+                  "stateless deleters and allocators must not grow the control block");
+    typename Impl::Alloc implAlloc { std::move(alloc) };
+    Impl *p = nullptr;
+    try {
+        p = Traits::allocate(implAlloc, 1);
+    } catch (...) {
+        deleter(ptr);
+        throw;
+    }
+    return ::new (static_cast<void *>(p)) Impl(ptr, std::move(deleter), std::move(implAlloc));
+}
+
+template<typename T>
+void SimpleSharedPtr<T>::DestroyRefCntObj(RefCounterModel *pRefCntObj)
+{
+    pRefCntObj->Destroy();
+}
+
+template<typename T>
+SimpleSharedPtr<T>::RefCounterModel::RefCounterModel(T* ptr)
+{
+    m_counter = 1;
+    m_obj = ptr;
+}
+
+template<typename T>
+void SimpleSharedPtr<T>::RefCounterModel::ShareOwnership()
+{
+    m_counter++;
+}
+
+template<typename T>
+T* SimpleSharedPtr<T>::RefCounterModel::Get() const
+{
+    return m_obj;
+}
+
+template<typename T>
+bool SimpleSharedPtr<T>::RefCounterModel::ReleaseOwnership()
+{
+    if (--m_counter == 0) {
+        if (m_obj) {
+            Dispose();
+        }
+        return true;
+    }
+
+    return false;
+}
+
+template<typename T>
+template<typename D, typename A>
+SimpleSharedPtr<T>::RefCounterImpl<D, A>::RefCounterImpl(T* ptr, D deleter, Alloc alloc)
+    : DeleterBase(std::move(deleter))
+    , AllocBase(std::move(alloc))
+    , RefCounterModel(ptr)
+{
+}
+
+template<typename T>
+template<typename D, typename A>
+void SimpleSharedPtr<T>::RefCounterImpl<D, A>::Dispose() noexcept
+{
+    DeleterBase::Get()(this->m_obj);
+}
+
+template<typename T>
+template<typename D, typename A>
+void SimpleSharedPtr<T>::RefCounterImpl<D, A>::Destroy() noexcept
+{
+    // 先把 allocator 移出来，析构之后再用它释放自己所在的内存。
+    Alloc alloc { std::move(AllocBase::Get()) };
+    this->~RefCounterImpl();
+    std::allocator_traits<Alloc>::deallocate(alloc, this, 1);
+}
@@ -0,0 +1,78 @@
+#include <array>
+#include <cstddef>
+
+#include <benchmark/benchmark.h>
+
+#include "cpp/idioms/copy_on_write.hpp"
+
+namespace {
+
+template<std::size_t N>
+struct Payload {
+    std::array<char, N> bytes {};
+};
+
+/// 有另一个持有者时写入：分配新块并复制 N 字节（N = 16 时内联存放，拷贝时已经复制过）。
+template<std::size_t N>
+void BM_CowDetach(benchmark::State &state)
+{
+    CopyOnWritePtr<Payload<N>> doc;
+    for (auto _ : state) {
+        CopyOnWritePtr<Payload<N>> snapshot { doc };
+        doc.GetMut()->bytes[0]++;
+        benchmark::DoNotOptimize(snapshot.GetImmut());
+    }
+    state.SetBytesProcessed(state.iterations() * N);
+}
+BENCHMARK_TEMPLATE(BM_CowDetach, 16);
+BENCHMARK_TEMPLATE(BM_CowDetach, 256);
+BENCHMARK_TEMPLATE(BM_CowDetach, 4096);
+
+/// 独占时写入：只有一次 acquire 读取判断唯一性，不复制。
+template<std::size_t N>
+void BM_CowWriteUnique(benchmark::State &state)
+{
+    CopyOnWritePtr<Payload<N>> doc;
+    for (auto _ : state) {
+        doc.GetMut()->bytes[0]++;
+        benchmark::DoNotOptimize(doc.GetImmut());
+    }
+}
+BENCHMARK_TEMPLATE(BM_CowWriteUnique, 4096);
+
+/// 多个线程拷贝同一个文档做快照：只有引用计数的争用。
+CopyOnWritePtr<Payload<256>> g_shared;
+
+void BM_CowSnapshotContended(benchmark::State &state)
+{
+    for (auto _ : state) {
+        CopyOnWritePtr<Payload<256>> snapshot { g_shared };
+        benchmark::DoNotOptimize(snapshot.GetImmut());
+    }
+}
+BENCHMARK(BM_CowSnapshotContended)->ThreadRange(1, 8)->UseRealTime();
+
+/// 与 Payload<16> 相同，但强制放在共享的堆块里，用来对比内联存放。
+struct HeapPayload16 : Payload<16> { };
+
+} // namespace
+
+template<>
+constexpr bool CowInlineStorage<HeapPayload16> = false;
+
+namespace {
+
+/// 小对象的快照加读取：内联时是复制 16 字节，堆存放时是引用计数的争用加一次跳转。
+template<typename P>
+void BM_CowSmallSnapshot(benchmark::State &state)
+{
+    static const CopyOnWritePtr<P> shared;
+    for (auto _ : state) {
+        CopyOnWritePtr<P> snapshot { shared };
+        benchmark::DoNotOptimize(snapshot.GetImmut()->bytes[0]);
+    }
+}
+BENCHMARK_TEMPLATE(BM_CowSmallSnapshot, Payload<16>)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_CowSmallSnapshot, HeapPayload16)->ThreadRange(1, 8)->UseRealTime();
+
+} // namespace
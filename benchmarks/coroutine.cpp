@@ -0,0 +1,170 @@
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "CoroutineUcontext.hpp"
+#include "CoroutineUcontext2.hpp"
+#include "Generator.hpp"
+#include "coroutine.h"
+
+namespace {
+
+constexpr std::size_t kStackSize = 64 * 1024;
+
+// 每次迭代恢复一次协程、协程再让出一次，即两次上下文切换。
+
+void BM_CoroTaskSwitch(benchmark::State &state)
+{
+    CoroContext context;
+    bool stop = false;
+    CoroTask task { context, kStackSize, [&stop](CoroTask &self) {
+        while (!stop) {
+            self.Yield();
+        }
+    } };
+    for (auto _ : state) {
+        task.Resume();
+    }
+    stop = true;
+    task.Resume();
+    state.counters["switches"] = benchmark::Counter(2.0 * state.iterations(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_CoroTaskSwitch);
+
+void BM_SimpleCoroutineSwitch(benchmark::State &state)
+{
+    bool stop = false;
+    SimpleCoroutine co { kStackSize, [&stop](SimpleCoroutine &self) {
+        while (!stop) {
+            self.yield();
+        }
+    } };
+    for (auto _ : state) {
+        co();
+    }
+    stop = true;
+    co();
+    state.counters["switches"] = benchmark::Counter(2.0 * state.iterations(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_SimpleCoroutineSwitch);
+
+void YieldUntilStopped(struct vml_coro_task *task, void *arg)
+{
+    while (!*static_cast<bool *>(arg)) {
+        vml_coro_yield(task);
+    }
+}
+
+/// coroutine.c 的调试输出只在没有定义 NDEBUG 时打印，请用 Release 构建。
+void BM_VmlCoroSwitch(benchmark::State &state)
+{
+    bool stop = false;
+    struct vml_coro_ctx *ctx = vml_coro_ctx_new();
+    struct vml_coro_task *task = vml_coro_task_new(ctx, kStackSize, YieldUntilStopped, &stop);
+    for (auto _ : state) {
+        vml_coro_resume(task);
+    }
+    stop = true;
+    vml_coro_resume(task);
+    vml_coro_task_destroy(task);
+    vml_coro_ctx_destroy(ctx);
+    state.counters["switches"] = benchmark::Counter(2.0 * state.iterations(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_VmlCoroSwitch);
+
+/// generator<int> 每个值的开销，参数是每次切换交付的值的个数。
+void BM_GeneratorNext(benchmark::State &state)
+{
+    generator<int> numbers { [](generator<int>::yielder &yield) {
+        for (int i = 0;; ++i) {
+            yield(i);
+        }
+    }, kStackSize, static_cast<std::size_t>(state.range(0)) };
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(numbers.next());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GeneratorNext)->Arg(1)->Arg(64);
+
+/// 已经结束的协程：Resume 立即返回，用来单独测量就绪队列，不含上下文切换。
+std::vector<std::unique_ptr<CoroTask>> FinishedTasks(CoroContext &context, std::size_t n)
+{
+    std::vector<std::unique_ptr<CoroTask>> tasks;
+    for (std::size_t i = 0; i < n; ++i) {
+        tasks.push_back(std::make_unique<CoroTask>(context, 16 * 1024, [](CoroTask &) {}));
+        tasks.back()->Resume();
+    }
+    return tasks;
+}
+
+/// 调度者线程上的 Resume 加 Schedule，参数是每轮入队的个数。
+void BM_CoroResumeLocal(benchmark::State &state)
+{
+    CoroContext context;
+    auto tasks = FinishedTasks(context, state.range(0));
+    for (auto _ : state) {
+        for (auto &task : tasks) {
+            context.Resume(task.get());
+        }
+        benchmark::DoNotOptimize(context.Schedule());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_CoroResumeLocal)->Arg(1)->Arg(64);
+
+/// 本线程每次迭代 ResumeRemote 一批，另一个线程运行调度循环，参数是批大小。
+/**
+ * 跨线程队列保持先进先出且只有一个生产者，所以调度者累计恢复的个数
+ * 达到某批入队时的累计入队数，这一批就都已出队，可以再次入队。
+ */
+void BM_CoroResumeRemote(benchmark::State &state)
+{
+    constexpr std::size_t kGroups = 8;
+    const std::size_t batch = state.range(0);
+    CoroContext context;
+    auto tasks = FinishedTasks(context, batch * kGroups);
+    std::vector<CoroTask *> ptrs;
+    for (auto &task : tasks) {
+        ptrs.push_back(task.get());
+    }
+
+    std::atomic<std::uint64_t> drained { 0 };
+    std::jthread scheduler { [&](std::stop_token stop) {
+        std::stop_callback wake { stop, [&]() { context.Notify(); } };
+        while (!stop.stop_requested()) {
+            const std::size_t n = context.Schedule();
+            drained.fetch_add(n, std::memory_order_release);
+            if (n == 0) {
+                context.WaitRemote();
+            }
+        }
+    } };
+
+    auto waitDrained = [&](std::uint64_t target) {
+        while (drained.load(std::memory_order_acquire) < target) {
+            std::this_thread::yield();
+        }
+    };
+    std::vector<std::uint64_t> pushedUpTo(kGroups, 0);
+    std::uint64_t pushed = 0;
+    std::size_t group = 0;
+    for (auto _ : state) {
+        waitDrained(pushedUpTo[group]);
+        context.ResumeRemote(std::span<CoroTask *const> { ptrs.data() + group * batch, batch });
+        pushed += batch;
+        pushedUpTo[group] = pushed;
+        group = (group + 1) % kGroups;
+    }
+    waitDrained(pushed);
+    state.SetItemsProcessed(state.iterations() * batch);
+}
+BENCHMARK(BM_CoroResumeRemote)->Arg(1)->Arg(16)->Arg(64)->UseRealTime();
+
+} // namespace
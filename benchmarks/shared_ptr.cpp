@@ -0,0 +1,48 @@
+#include <memory>
+
+#include <benchmark/benchmark.h>
+
+#include "SimpleSharedPtr.hpp"
+
+namespace {
+
+struct Payload {
+    long value = 0;
+};
+
+// 所有线程反复拷贝、析构同一个指针：每次迭代是引用计数上的两次原子 RMW，
+// 线程越多缓存行在核间来回越频繁。
+
+SimpleSharedPtr<Payload> g_simple { new Payload {} };
+std::shared_ptr<Payload> g_std { std::make_shared<Payload>() };
+
+void BM_SimpleSharedPtrCopy(benchmark::State &state)
+{
+    for (auto _ : state) {
+        SimpleSharedPtr<Payload> copy { g_simple };
+        benchmark::DoNotOptimize(copy.Get());
+    }
+}
+BENCHMARK(BM_SimpleSharedPtrCopy)->ThreadRange(1, 8)->UseRealTime();
+
+void BM_StdSharedPtrCopy(benchmark::State &state)
+{
+    for (auto _ : state) {
+        std::shared_ptr<Payload> copy { g_std };
+        benchmark::DoNotOptimize(copy.get());
+    }
+}
+BENCHMARK(BM_StdSharedPtrCopy)->ThreadRange(1, 8)->UseRealTime();
+
+/// 没有争用时的基线：每个线程拷贝自己的指针。
+void BM_SimpleSharedPtrCopyUncontended(benchmark::State &state)
+{
+    SimpleSharedPtr<Payload> local { new Payload {} };
+    for (auto _ : state) {
+        SimpleSharedPtr<Payload> copy { local };
+        benchmark::DoNotOptimize(copy.Get());
+    }
+}
+BENCHMARK(BM_SimpleSharedPtrCopyUncontended)->ThreadRange(1, 8)->UseRealTime();
+
+} // namespace
@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "thread_pool_v0.hpp"
+
+namespace {
+
+constexpr int kBatch = 1000;
+
+/// 1、2、4 …… 直到核数（至少 2，单核机器上也能看到争用）。
+void worker_counts(benchmark::internal::Benchmark* b)
+{
+  const int cores = std::max(2, static_cast<int>(std::thread::hardware_concurrency()));
+  for (int n = 1; n < cores; n *= 2) {
+    b->Arg(n);
+  }
+  b->Arg(cores);
+}
+
+/// 吞吐量：一批很小的任务提交后等待全部完成。
+void BM_thread_pool_throughput(benchmark::State& state)
+{
+  thread_pool pool {static_cast<std::size_t>(state.range(0))};
+  for (auto _: state) {
+    for (int k = 0; k < kBatch; ++k) {
+      pool.post([]() { benchmark::DoNotOptimize(0); });
+    }
+    pool.wait();
+  }
+  state.SetItemsProcessed(state.iterations() * kBatch);
+}
+BENCHMARK(BM_thread_pool_throughput)->Apply(worker_counts)->UseRealTime();
+
+/// 提交方的开销：submit() 本身（分配 packaged_task、入队、通知），不含执行。
+void BM_thread_pool_submit(benchmark::State& state)
+{
+  thread_pool pool {static_cast<std::size_t>(state.range(0))};
+  std::vector<std::future<void>> futures;
+  futures.reserve(kBatch);
+  for (auto _: state) {
+    futures.push_back(pool.submit([]() {}));
+    if (futures.size() == kBatch) {
+      state.PauseTiming();
+      pool.wait();
+      futures.clear();
+      state.ResumeTiming();
+    }
+  }
+  pool.wait();
+}
+BENCHMARK(BM_thread_pool_submit)->Apply(worker_counts)->UseRealTime();
+
+/// 往返延迟：submit 到 future 就绪，包括唤醒空闲 worker。
+void BM_thread_pool_round_trip(benchmark::State& state)
+{
+  thread_pool pool {static_cast<std::size_t>(state.range(0))};
+  for (auto _: state) {
+    pool.submit([]() {}).get();
+  }
+}
+BENCHMARK(BM_thread_pool_round_trip)->Apply(worker_counts)->UseRealTime();
+
+/// 开启跟踪后的吞吐量，与 BM_thread_pool_throughput 对比跟踪的开销。
+void BM_traced_thread_pool_throughput(benchmark::State& state)
+{
+  traced_thread_pool pool {static_cast<std::size_t>(state.range(0))};
+  for (auto _: state) {
+    for (int k = 0; k < kBatch; ++k) {
+      pool.post([]() { benchmark::DoNotOptimize(0); });
+    }
+    pool.wait();
+  }
+  state.SetItemsProcessed(state.iterations() * kBatch);
+}
+BENCHMARK(BM_traced_thread_pool_throughput)->Apply(worker_counts)->UseRealTime();
+
+} // namespace
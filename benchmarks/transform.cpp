@@ -0,0 +1,81 @@
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "cpp/gotchas/transform.hpp"
+#include "thread_pool_v0.hpp"
+
+namespace {
+
+template<typename T>
+std::vector<T> make_column(std::size_t n)
+{
+	std::vector<T> column(n);
+	std::uint64_t x = 88172645463325252u;
+	for (auto& value: column) {
+		x ^= x << 13, x ^= x >> 7, x ^= x << 17;
+		value = static_cast<T>(static_cast<std::int64_t>(x) >> 20);
+	}
+	return column;
+}
+
+template<typename T, typename V>
+void set_counters(benchmark::State& state, std::size_t n)
+{
+	state.SetItemsProcessed(state.iterations() * n);
+	state.SetBytesProcessed(state.iterations() * n * (sizeof(T) + sizeof(V)));
+}
+
+/// 原来的写法：范围构造，逐个隐式转换，不饱和。
+template<typename T, typename V>
+void BM_transform_range_ctor(benchmark::State& state)
+{
+	const auto column = make_column<T>(state.range(0));
+	for (auto _: state) {
+		std::vector<V> result(column.begin(), column.end());
+		benchmark::DoNotOptimize(result.data());
+	}
+	set_counters<T, V>(state, column.size());
+}
+
+/// transform<V>：memcpy / SIMD 内核 / 逐个转换，在编译期选择。
+template<typename T, typename V>
+void BM_transform(benchmark::State& state)
+{
+	const auto column = make_column<T>(state.range(0));
+	for (auto _: state) {
+		auto result = transform<V>(column);
+		benchmark::DoNotOptimize(result.data());
+	}
+	set_counters<T, V>(state, column.size());
+}
+
+/// 分块交给线程池，每个核一个 worker。
+template<typename T, typename V>
+void BM_transform_parallel(benchmark::State& state)
+{
+	const auto column = make_column<T>(state.range(0));
+	thread_pool pool {std::max(1u, std::thread::hardware_concurrency())};
+	for (auto _: state) {
+		auto result = transform<V>(column, pool);
+		benchmark::DoNotOptimize(result.data());
+	}
+	set_counters<T, V>(state, column.size());
+}
+
+#define TRANSFORM_BENCHMARKS(T, V) \
+	BENCHMARK_TEMPLATE(BM_transform_range_ctor, T, V)->RangeMultiplier(64)->Range(1 << 10, 1 << 22); \
+	BENCHMARK_TEMPLATE(BM_transform, T, V)->RangeMultiplier(64)->Range(1 << 10, 1 << 22); \
+	BENCHMARK_TEMPLATE(BM_transform_parallel, T, V)->Arg(1 << 22)->UseRealTime()
+
+TRANSFORM_BENCHMARKS(std::int32_t, std::int32_t);
+TRANSFORM_BENCHMARKS(std::int32_t, float);
+TRANSFORM_BENCHMARKS(std::int64_t, double);
+TRANSFORM_BENCHMARKS(float, std::int32_t);
+TRANSFORM_BENCHMARKS(double, float);
+TRANSFORM_BENCHMARKS(std::int32_t, std::int16_t);
+TRANSFORM_BENCHMARKS(std::int64_t, std::int32_t);
+
+} // namespace
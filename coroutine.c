@@ -7,22 +7,11 @@
 #include <unistd.h>
 #include <ucontext.h>
 
-#define VML_MIN_STACK_SIZE  4096u
-
-struct vml_coro_ctx;
-struct vml_coro_task;
-
-struct vml_coro_ctx *vml_coro_ctx_new();
-int vml_coro_ctx_destroy(struct vml_coro_ctx *ctx);
-
-struct vml_coro_task *vml_coro_task_new(struct vml_coro_ctx *ctx, size_t stksize, void (*)(struct vml_coro_task *, void *arg), void *arg);
-int vml_coro_task_destroy(struct vml_coro_task *task);
-
-void vml_coro_yield(struct vml_coro_task *task);
-void vml_coro_resume(struct vml_coro_task *task);
+#include "coroutine.h"
 
 struct vml_coro_ctx {
     ucontext_t caller;
+    struct vml_allocator allocator;
 };
 
 struct vml_coro_task {
@@ -35,9 +24,33 @@ struct vml_coro_task {
     bool done;
 };
 
+static void *default_alloc(void *state, size_t size)
+{
+    (void) state;
+    return malloc(size);
+}
+
+static void default_free(void *state, void *ptr, size_t size)
+{
+    (void) state;
+    (void) size;
+    free(ptr);
+}
+
 struct vml_coro_ctx *vml_coro_ctx_new()
 {
-    struct vml_coro_ctx *ctx = (struct vml_coro_ctx *) malloc(sizeof(struct vml_coro_ctx));
+    struct vml_allocator allocator = { default_alloc, default_free, NULL };
+    return vml_coro_ctx_new_with_allocator(&allocator);
+}
+
+struct vml_coro_ctx *vml_coro_ctx_new_with_allocator(const struct vml_allocator *allocator)
+{
+    if (!allocator || !allocator->alloc || !allocator->free)
+        return NULL;
+    struct vml_coro_ctx *ctx = (struct vml_coro_ctx *) allocator->alloc(allocator->state, sizeof(struct vml_coro_ctx));
+    if (!ctx)
+        return NULL;
+    ctx->allocator = *allocator;
     return ctx;
 }
 
@@ -45,7 +58,8 @@ int vml_coro_ctx_destroy(struct vml_coro_ctx *ctx)
 {
     if (!ctx)
         return -1;
-    free(ctx);
+    struct vml_allocator allocator = ctx->allocator;
+    allocator.free(allocator.state, ctx, sizeof(struct vml_coro_ctx));
     return 0;
 }
 
@@ -60,12 +74,13 @@ struct vml_coro_task *vml_coro_task_new(struct vml_coro_ctx *ctx, size_t stksize
     if (!callback)
         return NULL;
 
-    struct vml_coro_task *task = (struct vml_coro_task *) malloc(sizeof(struct vml_coro_task *));
+    const struct vml_allocator *allocator = &ctx->allocator;
+    struct vml_coro_task *task = (struct vml_coro_task *) allocator->alloc(allocator->state, sizeof(struct vml_coro_task));
     if (!task)
         return NULL;
-    uint8_t *stack = (uint8_t *) malloc(stksize);
+    uint8_t *stack = (uint8_t *) allocator->alloc(allocator->state, stksize);
     if (!stack) {
-        free(task);
+        allocator->free(allocator->state, task, sizeof(struct vml_coro_task));
         return NULL;
     }
     task->stack = stack;
@@ -93,15 +108,18 @@ int vml_coro_task_destroy(struct vml_coro_task *task)
 {
     if (!task)
         return -1;
-    free(task->stack);
-    free(task);
+    const struct vml_allocator *allocator = &task->ctx->allocator;
+    allocator->free(allocator->state, task->stack, task->stksize);
+    allocator->free(allocator->state, task, sizeof(struct vml_coro_task));
     return 0;
 }
 
 void vml_coro_yield(struct vml_coro_task *task)
 {
     assert(task);
+#ifndef NDEBUG
     puts("yield");
+#endif
     swapcontext(&task->callee, &task->ctx->caller);
 }
 
@@ -110,7 +128,9 @@ void vml_coro_resume(struct vml_coro_task *task)
     assert(task);
     if (task->done)
         return;
+#ifndef NDEBUG
     puts("resume");
+#endif
     swapcontext(&task->ctx->caller, &task->callee);
 }
 
@@ -125,32 +145,8 @@ static void callbackwrapper(struct vml_coro_task *task)
     assert(task);
 //    puts("wrapper");
     task->callback(task, task->arg);
+#ifndef NDEBUG
     puts("done");
+#endif
     task->done = true;
 }
-
-void print_five_times(struct vml_coro_task *task, void* arg)
-{
-    for (uint8_t i = 0; i < 5; ++i) {
-        printf("hello world %i\n", i);
-        vml_coro_yield(task);
-    }
-}
-
-int main(int argc, const char* argv[])
-{
-    struct vml_coro_ctx *ctx = vml_coro_ctx_new();
-    assert(ctx);
-    struct vml_coro_task *task = vml_coro_task_new(ctx, VML_MIN_STACK_SIZE, print_five_times, NULL);
-    assert(task);
-
-    while (!vml_coro_done(task)) { 
-        puts("main");
-        vml_coro_resume(task);
-    }
-
-    vml_coro_task_destroy(task);
-    vml_coro_ctx_destroy(ctx);
-    return 0;
-}
-
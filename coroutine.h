@@ -0,0 +1,39 @@
+#ifndef VML_COROUTINE_H
+#define VML_COROUTINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VML_MIN_STACK_SIZE  4096u
+
+struct vml_coro_ctx;
+struct vml_coro_task;
+
+/* 内存分配钩子：上下文、任务和协程栈都经由它分配，size 在释放时一并传回，
+ * 便于接入 arena 或定长块池。 */
+struct vml_allocator {
+    void *(*alloc)(void *state, size_t size);
+    void (*free)(void *state, void *ptr, size_t size);
+    void *state;
+};
+
+struct vml_coro_ctx *vml_coro_ctx_new(void);
+struct vml_coro_ctx *vml_coro_ctx_new_with_allocator(const struct vml_allocator *allocator);
+int vml_coro_ctx_destroy(struct vml_coro_ctx *ctx);
+
+struct vml_coro_task *vml_coro_task_new(struct vml_coro_ctx *ctx, size_t stksize, void (*)(struct vml_coro_task *, void *arg), void *arg);
+int vml_coro_task_destroy(struct vml_coro_task *task);
+
+void vml_coro_yield(struct vml_coro_task *task);
+void vml_coro_resume(struct vml_coro_task *task);
+bool vml_coro_done(struct vml_coro_task *task);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
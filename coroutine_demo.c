@@ -0,0 +1,69 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "coroutine.h"
+
+void print_five_times(struct vml_coro_task *task, void* arg)
+{
+    (void) arg;
+    for (uint8_t i = 0; i < 5; ++i) {
+        printf("hello world %i\n", i);
+        vml_coro_yield(task);
+    }
+}
+
+/* 请求级的单调分配器示例：释放是空操作，请求结束时整块丢弃。 */
+struct bump_arena {
+    uint8_t *base;
+    size_t used;
+    size_t capacity;
+};
+
+static void *bump_alloc(void *state, size_t size)
+{
+    struct bump_arena *arena = (struct bump_arena *) state;
+    size_t offset = (arena->used + 15u) & ~(size_t) 15u;
+    if (offset + size > arena->capacity)
+        return NULL;
+    arena->used = offset + size;
+    return arena->base + offset;
+}
+
+static void bump_free(void *state, void *ptr, size_t size)
+{
+    (void) state;
+    (void) ptr;
+    (void) size;
+}
+
+int main(int argc, const char* argv[])
+{
+    struct vml_coro_ctx *ctx = vml_coro_ctx_new();
+    assert(ctx);
+    struct vml_coro_task *task = vml_coro_task_new(ctx, VML_MIN_STACK_SIZE, print_five_times, NULL);
+    assert(task);
+
+    while (!vml_coro_done(task)) { 
+        puts("main");
+        vml_coro_resume(task);
+    }
+
+    vml_coro_task_destroy(task);
+    vml_coro_ctx_destroy(ctx);
+
+    static _Alignas(16) uint8_t buffer[4 * VML_MIN_STACK_SIZE];
+    struct bump_arena arena = { buffer, 0, sizeof(buffer) };
+    struct vml_allocator allocator = { bump_alloc, bump_free, &arena };
+    ctx = vml_coro_ctx_new_with_allocator(&allocator);
+    assert(ctx);
+    task = vml_coro_task_new(ctx, VML_MIN_STACK_SIZE, print_five_times, NULL);
+    assert(task);
+    while (!vml_coro_done(task))
+        vml_coro_resume(task);
+    vml_coro_task_destroy(task);
+    vml_coro_ctx_destroy(ctx);
+    printf("arena used %zu bytes\n", arena.used);
+    return 0;
+}
+
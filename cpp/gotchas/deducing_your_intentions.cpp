@@ -1,18 +1,42 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
 #include <vector>
 
-template<typename T, typename V>
-auto transform(std::vector<T> const& vt) -> std::vector<V>
-{
-	std::vector<V> result {vt.ebgin(), vt.end()};
-	assert(vt.size() == result.size());
-	return result;
-}
+#include "cpp/gotchas/transform.hpp"
+#include "thread_pool_v0.hpp"
+
+// 原来的写法：
+//
+//	template<typename T, typename V>
+//	auto transform(std::vector<T> const& vt) -> std::vector<V>;
+//	transform(v);
+//
+// V 只出现在返回类型里，返回类型不参与推导，所以 transform(v) 推导不出 V。
+// transform.hpp 把 V 放在第一个、让它可以显式给出，T 仍由实参推导；
+// 不给 V 时返回一个带模板转换运算符的代理，由接收结果的变量“推导”V。
 
 int main(int argc, const char *argv[])
 {
 	std::vector v {1};
+	// 另一个坑：这是拷贝，w 是 std::vector<int>，不是 std::vector<std::vector<int>>。
 	std::vector w {v};
-	transform(v);
-	transform(w);
-}
+	static_assert(std::is_same_v<decltype(w), std::vector<int>>);
 
+	auto f = transform<float>(v);
+	std::vector<double> d = transform(w);
+	std::printf("transform<float>: %g, deduced double: %g\n", f[0], d[0]);
+
+	// 窄化按目标类型的范围饱和，NaN 得到 0；这些规则和各 SIMD 内核的逐位一致性由 tests/transform.cpp 检查。
+	auto i32 = transform<std::int32_t>(std::vector<float> {3e9f, -3e9f, NAN, -1.9f});
+	std::printf("saturated: %d %d %d %d\n", i32[0], i32[1], i32[2], i32[3]);
+
+	// 大输入分块交给线程池。
+	thread_pool pool {4};
+	std::vector<std::int32_t> column(3'000'001);
+	for (std::size_t i = 0; i < column.size(); ++i) {
+		column[i] = static_cast<std::int32_t>(i * 2654435761u);
+	}
+	auto parallel = transform<float>(column, pool);
+	std::printf("converted %zu values, last %g\n", parallel.size(), parallel.back());
+}
@@ -0,0 +1,367 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "task_scope.hpp"
+
+// std::vector<T> -> std::vector<V> 的逐元素转换。
+//
+//	auto f = transform<float>(ints);            // V 显式给出，T 由实参推导
+//	std::vector<double> d = transform(ints);    // V 由接收的变量推导
+//	auto big = transform<float>(ints, pool);    // 大输入按块分给线程池
+//
+// 转换规则：整数之间、浮点到整数的窄化按目标类型的范围饱和（NaN 得到 0），
+// 其余算术转换同 static_cast，非算术类型用 V 的构造函数。
+// 实现在编译期选择：布局相同时 memcpy；有 SIMD 内核的类型对用 AVX2/SSE2
+// （取决于编译选项，例如 -march=native），剩余元素逐个转换；其余逐个转换。
+
+namespace transform_detail {
+
+template<typename T>
+concept plain_integer = std::integral<T>
+	&& !std::same_as<T, bool> && !std::same_as<T, char> && !std::same_as<T, wchar_t>
+	&& !std::same_as<T, char8_t> && !std::same_as<T, char16_t> && !std::same_as<T, char32_t>;
+
+template<typename T>
+concept number = plain_integer<T> || std::floating_point<T>;
+
+/// 二者的对象表示逐字节相同，可以整块复制。
+template<typename T, typename V>
+inline constexpr bool same_layout = std::is_same_v<T, V>
+	|| (plain_integer<T> && plain_integer<V> && sizeof(T) == sizeof(V)
+		&& std::is_signed_v<T> == std::is_signed_v<V>);
+
+/// 单个元素的转换，SIMD 内核的结果必须与它逐位一致。
+template<typename V, typename T>
+constexpr V convert_value(T x) noexcept
+{
+	if constexpr (plain_integer<V> && plain_integer<T>) {
+		// 写成比较加选择而不是分支，没有 SIMD 内核的类型对编译器也能向量化。
+		constexpr auto min = std::numeric_limits<V>::min();
+		constexpr auto max = std::numeric_limits<V>::max();
+		return std::cmp_less(x, min) ? min : std::cmp_greater(x, max) ? max : static_cast<V>(x);
+	} else if constexpr (plain_integer<V> && std::floating_point<T>) {
+		// 2^bits（无符号）或 2^(bits-1)（有符号），在 T 中可以精确表示。
+		constexpr T upper = static_cast<T>(std::numeric_limits<V>::max() / 2 + 1) * 2;
+		if (x != x) {
+			return 0;
+		}
+		if (x >= upper) {
+			return std::numeric_limits<V>::max();
+		}
+		if (x <= static_cast<T>(std::numeric_limits<V>::min())) {
+			return std::numeric_limits<V>::min();
+		}
+		return static_cast<V>(x);
+	} else {
+		return static_cast<V>(x);
+	}
+}
+
+// SIMD 内核：处理前缀，返回处理了多少个元素，剩余的由调用者逐个转换。
+// AVX2 主循环之后 SSE2 再处理一段，标量只剩不到 4 个元素。
+
+/// 没有内核的类型对。
+template<typename T, typename V>
+std::size_t simd_convert(const T*, std::size_t, V*) noexcept
+{
+	return 0;
+}
+
+inline std::size_t simd_convert(const std::int32_t* in, std::size_t n, float* out) noexcept
+{
+	std::size_t i = 0;
+#if defined(__AVX2__)
+	for (; i + 8 <= n; i += 8) {
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+		_mm256_storeu_ps(out + i, _mm256_cvtepi32_ps(v));
+	}
+#endif
+#if defined(__SSE2__)
+	for (; i + 4 <= n; i += 4) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+		_mm_storeu_ps(out + i, _mm_cvtepi32_ps(v));
+	}
+#endif
+	return i;
+}
+
+// int64 -> double 没有 AVX-512 之前的指令。把高低 32 位分别放进 2^84 和 2^52 量级的
+// double 的尾数里，减去偏移再相加：高位部分的减法是精确的，只有最后的加法舍入一次，
+// 结果与 cvtsi2sd 相同。
+inline std::size_t simd_convert(const std::int64_t* in, std::size_t n, double* out) noexcept
+{
+	std::size_t i = 0;
+#if defined(__AVX2__)
+	{
+		const __m256i magic_lo = _mm256_set1_epi64x(0x4330000000000000);  // 2^52
+		const __m256i magic_hi = _mm256_set1_epi64x(0x4530000080000000);  // 2^84 + 2^63
+		const __m256d magic_all = _mm256_castsi256_pd(_mm256_set1_epi64x(0x4530000080100000));
+		for (; i + 4 <= n; i += 4) {
+			__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+			__m256i lo = _mm256_blend_epi32(magic_lo, v, 0b01010101);
+			__m256i hi = _mm256_xor_si256(_mm256_srli_epi64(v, 32), magic_hi);
+			__m256d d = _mm256_sub_pd(_mm256_castsi256_pd(hi), magic_all);
+			_mm256_storeu_pd(out + i, _mm256_add_pd(d, _mm256_castsi256_pd(lo)));
+		}
+	}
+#endif
+#if defined(__SSE2__)
+	{
+		const __m128i low_mask = _mm_set1_epi64x(0xffffffff);
+		const __m128i magic_lo = _mm_set1_epi64x(0x4330000000000000);
+		const __m128i magic_hi = _mm_set1_epi64x(0x4530000080000000);
+		const __m128d magic_all = _mm_castsi128_pd(_mm_set1_epi64x(0x4530000080100000));
+		for (; i + 2 <= n; i += 2) {
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+			__m128i lo = _mm_or_si128(_mm_and_si128(v, low_mask), magic_lo);
+			__m128i hi = _mm_xor_si128(_mm_srli_epi64(v, 32), magic_hi);
+			__m128d d = _mm_sub_pd(_mm_castsi128_pd(hi), magic_all);
+			_mm_storeu_pd(out + i, _mm_add_pd(d, _mm_castsi128_pd(lo)));
+		}
+	}
+#endif
+	return i;
+}
+
+// cvttps 对 NaN 和越界的值都给出 INT32_MIN，负向越界本来就是正确的饱和值，
+// 只需修正正向越界（>= 2^31）和 NaN。
+inline std::size_t simd_convert(const float* in, std::size_t n, std::int32_t* out) noexcept
+{
+	std::size_t i = 0;
+#if defined(__AVX2__)
+	{
+		const __m256 upper = _mm256_set1_ps(2147483648.0f);
+		const __m256i max = _mm256_set1_epi32(std::numeric_limits<std::int32_t>::max());
+		for (; i + 8 <= n; i += 8) {
+			__m256 x = _mm256_loadu_ps(in + i);
+			__m256i r = _mm256_cvttps_epi32(x);
+			r = _mm256_blendv_epi8(r, max, _mm256_castps_si256(_mm256_cmp_ps(x, upper, _CMP_GE_OQ)));
+			r = _mm256_andnot_si256(_mm256_castps_si256(_mm256_cmp_ps(x, x, _CMP_UNORD_Q)), r);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), r);
+		}
+	}
+#endif
+#if defined(__SSE2__)
+	{
+		const __m128 upper = _mm_set1_ps(2147483648.0f);
+		const __m128i max = _mm_set1_epi32(std::numeric_limits<std::int32_t>::max());
+		for (; i + 4 <= n; i += 4) {
+			__m128 x = _mm_loadu_ps(in + i);
+			__m128i r = _mm_cvttps_epi32(x);
+			__m128i over = _mm_castps_si128(_mm_cmpge_ps(x, upper));
+			r = _mm_or_si128(_mm_andnot_si128(over, r), _mm_and_si128(over, max));
+			r = _mm_andnot_si128(_mm_castps_si128(_mm_cmpunord_ps(x, x)), r);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), r);
+		}
+	}
+#endif
+	return i;
+}
+
+inline std::size_t simd_convert(const double* in, std::size_t n, float* out) noexcept
+{
+	std::size_t i = 0;
+#if defined(__AVX2__)
+	for (; i + 4 <= n; i += 4) {
+		_mm_storeu_ps(out + i, _mm256_cvtpd_ps(_mm256_loadu_pd(in + i)));
+	}
+#endif
+#if defined(__SSE2__)
+	for (; i + 2 <= n; i += 2) {
+		_mm_storel_pi(reinterpret_cast<__m64*>(out + i), _mm_cvtpd_ps(_mm_loadu_pd(in + i)));
+	}
+#endif
+	return i;
+}
+
+// packs 本身就是有符号饱和。
+inline std::size_t simd_convert(const std::int32_t* in, std::size_t n, std::int16_t* out) noexcept
+{
+	std::size_t i = 0;
+#if defined(__AVX2__)
+	for (; i + 16 <= n; i += 16) {
+		__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+		__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i + 8));
+		// packs 在每个 128 位通道内交错 a、b，再把 64 位块排回顺序。
+		__m256i r = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0b11011000);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), r);
+	}
+#endif
+#if defined(__SSE2__)
+	for (; i + 8 <= n; i += 8) {
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 4));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(a, b));
+	}
+#endif
+	return i;
+}
+
+// 64 位比较要到 SSE4.2/AVX2 才有，所以没有 SSE2 版本。
+inline std::size_t simd_convert(const std::int64_t* in, std::size_t n, std::int32_t* out) noexcept
+{
+	std::size_t i = 0;
+#if defined(__AVX2__)
+	const __m256i max = _mm256_set1_epi64x(std::numeric_limits<std::int32_t>::max());
+	const __m256i min = _mm256_set1_epi64x(std::numeric_limits<std::int32_t>::min());
+	const __m256i low_dwords = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+	for (; i + 4 <= n; i += 4) {
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+		v = _mm256_blendv_epi8(v, max, _mm256_cmpgt_epi64(v, max));
+		v = _mm256_blendv_epi8(v, min, _mm256_cmpgt_epi64(min, v));
+		v = _mm256_permutevar8x32_epi32(v, low_dwords);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm256_castsi256_si128(v));
+	}
+#else
+	(void)in, (void)n, (void)out;
+#endif
+	return i;
+}
+
+/// 把 [in, in + n) 转换到 out，out 已有 n 个元素的空间。
+template<typename V, typename T>
+void convert_n(const T* in, std::size_t n, V* out) noexcept
+{
+	if constexpr (same_layout<T, V>) {
+		if (n > 0) {
+			std::memcpy(out, in, n * sizeof(T));
+		}
+	} else {
+		const std::size_t done = simd_convert(in, n, out);
+		std::transform(in + done, in + n, out + done, convert_value<V, T>);
+	}
+}
+
+/// 每块的元素数：块内的输入和输出大致放得进 L2。
+inline constexpr std::size_t parallel_grain = std::size_t {1} << 16;
+
+/// 小于这个元素数不值得分块：转换是访存受限的，任务调度和唤醒的开销占不到便宜。
+inline constexpr std::size_t parallel_threshold = std::size_t {1} << 20;
+
+struct deduce;
+
+/// 不指定 V 时的返回值：转换成哪种 std::vector<V>，就推导出哪个 V。
+template<typename T>
+class deferred
+{
+public:
+	explicit deferred(std::vector<T> const& vt) noexcept
+		: vt_ {vt}
+	{
+	}
+
+	deferred(deferred const&) = delete;
+	deferred& operator=(deferred const&) = delete;
+
+	template<typename V>
+	operator std::vector<V>() const&&;
+
+private:
+	std::vector<T> const& vt_;
+};
+
+} // namespace transform_detail
+
+/// V 不给出时返回一个代理，由接收结果的 std::vector<V> 推导 V：
+/// std::vector<double> d = transform(v);
+/**
+ * 代理引用 vt，只能立即转换，不要用 auto 保存它。
+ */
+template<typename V = transform_detail::deduce, typename T>
+auto transform(std::vector<T> const& vt)
+{
+	if constexpr (std::is_same_v<V, transform_detail::deduce>) {
+		return transform_detail::deferred<T> {vt};
+	} else if constexpr (transform_detail::same_layout<T, V>) {
+		// 相同类型时范围构造就是 memmove。
+		return std::vector<V>(vt.begin(), vt.end());
+	} else if constexpr (transform_detail::number<T> && transform_detail::number<V>) {
+		// 先转换到栈上的小缓冲区再追加：vector(n) 会先值初始化，多写一遍输出，
+		// 而缓冲区留在 L1 里，追加的复制几乎不花时间。
+		constexpr std::size_t staging = 1024;
+		V buffer[staging];
+		std::vector<V> result;
+		result.reserve(vt.size());
+		for (std::size_t first = 0; first < vt.size(); first += staging) {
+			const std::size_t count = std::min(staging, vt.size() - first);
+			transform_detail::convert_n(vt.data() + first, count, buffer);
+			result.insert(result.end(), buffer, buffer + count);
+		}
+		return result;
+	} else {
+		std::vector<V> result(vt.begin(), vt.end());
+		assert(vt.size() == result.size());
+		return result;
+	}
+}
+
+/// 大输入按 parallel_grain 分块交给线程池，调用者线程处理第一块。
+/**
+ * 非算术类型和较小的输入直接在调用者线程上转换。在 pool 的 worker 上调用也不会死锁：
+ * 等待期间 task_scope 会执行排队中的块。
+ * 线程池拒绝、丢弃或（因为别的块失败而）跳过的块，最后由调用者线程补上，结果总是完整的。
+ */
+template<typename V, typename T, typename Pool>
+auto transform(std::vector<T> const& vt, Pool& pool) -> std::vector<V>
+{
+	using namespace transform_detail;
+	if constexpr (number<T> && number<V>) {
+		const std::size_t n = vt.size();
+		if (n >= parallel_threshold) {
+			// 值初始化是单线程的一遍写，但它同时完成了缺页，各块随后只是覆盖写。
+			std::vector<V> result(n);
+			const T* in = vt.data();
+			V* out = result.data();
+			const std::size_t chunks = (n + parallel_grain - 1) / parallel_grain;
+			// 每块各写自己的字节，join 之后再读，不需要原子操作。
+			std::vector<unsigned char> converted(chunks);
+			{
+				// 不调用 wait()：子任务失败只可能是没有执行，下面统一补上。
+				task_scope scope {pool};
+				for (std::size_t k = 1; k < chunks; ++k) {
+					const std::size_t first = k * parallel_grain;
+					const std::size_t count = std::min(parallel_grain, n - first);
+					unsigned char* done = &converted[k];
+					if (!scope.spawn([=]() {
+							convert_n(in + first, count, out + first);
+							*done = 1;
+						})) {
+						// scope 已经取消，后面的块即使投递出去也会被跳过。
+						break;
+					}
+				}
+				convert_n(in, std::min(parallel_grain, n), out);
+				converted[0] = 1;
+			}
+			for (std::size_t k = 1; k < chunks; ++k) {
+				if (!converted[k]) {
+					const std::size_t first = k * parallel_grain;
+					convert_n(in + first, std::min(parallel_grain, n - first), out + first);
+				}
+			}
+			return result;
+		}
+	}
+	return transform<V>(vt);
+}
+
+template<typename T>
+template<typename V>
+transform_detail::deferred<T>::operator std::vector<V>() const&&
+{
+	return ::transform<V>(vt_);
+}
@@ -1,106 +1,16 @@
 #include <iostream>
-#include <memory>
 #include <string>
-#include <concepts>
-#include <type_traits>
-#include <mutex>
+#include <thread>
+#include <vector>
 
-template<typename T>
-struct TraitCopyable {
-    TraitCopyable()
-    {
-        // 可以使用trait类模板和CRTP，对子类进行约束。
-        static_assert(std::copyable<T>);
-    }
-};
-
-#define DEFINE_TRAIT_CLASS(trait) \
-    namespace { \
-        using namespace std; \
-        template<typename T> \
-        struct CheckTrait##trait { \
-            CheckTrait##trait() \
-            { \
-                static_assert(trait<T>); \
-            } \
-        }; \
-    }
-    
-#define ENFORCE_TRAIT(trait, t) \
-    CheckTrait##trait<t>
-
-DEFINE_TRAIT_CLASS(copyable);
-
-template<std::copyable T>
-class CopyOnWritePtr
-    //: public TraitCopyable<CopyOnWritePtr<T>> {
-    : public ENFORCE_TRAIT(copyable, CopyOnWritePtr<T>) {
-    // 无法在这里直接约束CopyOnWritePtr类模板为某个concept，只有在实例化时方可约束。
-    // 因为CopyOnWritePtr这时是incomplete type
-    //static_assert(std::copyable<CopyOnWritePtr<T>>);
-    //static_assert(std::copyable<std::shared_ptr<T>>);
-public:
-    /** */
-    CopyOnWritePtr();
-    /** */
-    CopyOnWritePtr(const CopyOnWritePtr &robj) = default;
-    /** */
-    template<typename... Ts>
-    CopyOnWritePtr(Ts... ts); // 注意：universal absorber when a ctor of certain form is not declared.
-    /** */
-    CopyOnWritePtr &operator=(const CopyOnWritePtr &robj) = default;
-    /** */
-    ~CopyOnWritePtr() = default;
-    
-    /** */
-    T *GetMut();
-    /** */
-    const T *GetImmut() const;
-    
-private:
-    /** */
-    void detach();
-
-private:
-    std::shared_ptr<T> data_;
-};
-
-template<std::copyable T>
-CopyOnWritePtr<T>::CopyOnWritePtr()
-    : data_{std::make_shared<T>()}
-{
-}
-
-template<std::copyable T>
-template<typename... Ts>
-CopyOnWritePtr<T>::CopyOnWritePtr(Ts... ts)
-{
-    data_ = std::make_shared<T>(ts...);
-}
-
-template<std::copyable T>
-T *CopyOnWritePtr<T>::GetMut()
-{
-    detach();
-    return data_.get();
-}
-
-template<std::copyable T>
-const T *CopyOnWritePtr<T>::GetImmut() const
-{
-    return data_.get();
-}
-
-template<std::copyable T>
-void CopyOnWritePtr<T>::detach()
-{
-    if (data_ && data_.use_count() > 1) {
-        data_ = std::make_shared<T>(*data_);
-    }
-}
+#include "copy_on_write.hpp"
 
 class MyTestClassImpl {
 public:
+    // 字段编号，供 CopyOnWritePtr 的字段级变更跟踪使用。
+    enum Field : std::size_t { Member1, Member2 };
+    static constexpr std::size_t kTrackedFields = 2;
+
     void SetMember1(const std::string &val)
     {
         member1_ = val;
@@ -111,16 +21,32 @@ public:
         // 返回值类型可以是引用
         return member1_;
     }
+
+    void SetMember2(int val)
+    {
+        member2_ = val;
+    }
+
+    int GetMember2() const
+    {
+        return member2_;
+    }
     
 private:
     std::string member1_;
+    int member2_ = 0;
 };
 
 class MyTestClass {
 public:    
     void SetMember1(const std::string &val)
     {
-        data_.GetMut()->SetMember1(val);
+        data_.GetMut(MyTestClassImpl::Member1)->SetMember1(val);
+    }
+
+    void SetMember2(int val)
+    {
+        data_.GetMut(MyTestClassImpl::Member2)->SetMember2(val);
     }
     
     std::string GetMember1() const
@@ -130,6 +56,30 @@ public:
         // 内部的共享对象。这是，之前拿到的引用已经不属于当下所持有的共享对象。
         return data_.GetImmut()->GetMember1();
     }
+
+    int GetMember2() const
+    {
+        return data_.GetImmut()->GetMember2();
+    }
+
+    /** 快照版本，相同即内容相同，可以跳过重新编码。 */
+    std::uint64_t Version() const
+    {
+        return data_.Version();
+    }
+
+    /** */
+    bool SharesWith(const MyTestClass &robj) const
+    {
+        return data_.SharesWith(robj.data_);
+    }
+
+    /** 相对于 base 快照改过的字段，按 MyTestClassImpl::Field 编号。 */
+    auto ChangedFields(const MyTestClass &base) const
+    {
+        return data_.ChangedFields(base.data_);
+    }
+
 private:
     CopyOnWritePtr<MyTestClassImpl> data_;
 };
@@ -165,5 +115,48 @@ int main(int argc, const char *argv[])
     mytest0.SetMember1("good answer");
     std::cout << "mytest0: " << mytest0.GetMember1() << std::endl;
     std::cout << "mytest1: " << mytest1.GetMember1() << std::endl;
+
+    // 复制路径：只重新编码版本变化的快照，并且只编码变化的字段。
+    MyTestClass replicated = mytest0;
+    MyTestClass current = mytest0;
+    std::cout << "shares: " << current.SharesWith(replicated)
+              << " changed: " << current.ChangedFields(replicated) << std::endl;
+    current.SetMember2(42);
+    current.SetMember2(43);
+    std::cout << "shares: " << current.SharesWith(replicated)
+              << " version changed: " << (current.Version() != replicated.Version())
+              << " changed: " << current.ChangedFields(replicated) << std::endl;
+    current.SetMember1("again");
+    std::cout << "changed: " << current.ChangedFields(replicated) << std::endl;
+
+    // 多个线程各持一份拷贝并发写入，共享块最多被复制一次/线程。
+    CopyOnWritePtr<std::vector<int>> shared { std::size_t{16}, 0 };
+    std::vector<std::thread> writers;
+    for (int i = 0; i < 4; ++i) {
+        writers.emplace_back([copy = shared, i]() mutable {
+            for (int j = 0; j < 100000; ++j) {
+                copy.GetMut()->at(j % 16) += i;
+            }
+        });
+    }
+    for (auto &t : writers) {
+        t.join();
+    }
+    std::cout << "shared[0]: " << shared.GetImmut()->at(0) << std::endl;
+    std::cout << "detaches(vector<int>): " << CopyOnWritePtr<std::vector<int>>::DetachCount() << std::endl;
+
+    // 小对象内联存放：复制就是复制值，没有分配、没有引用计数，读取也不用跳转。
+    struct Limits {
+        int maxConnections = 16;
+        int timeoutMs = 500;
+    };
+    CopyOnWritePtr<Limits> limits;
+    CopyOnWritePtr<Limits> limitsCopy = limits;
+    std::cout << "sizeof(CopyOnWritePtr<Limits>): " << sizeof(limits)
+              << " same snapshot: " << limitsCopy.SharesWith(limits) << std::endl;
+    limitsCopy.GetMut()->timeoutMs = 1000;
+    std::cout << "timeout: " << limits.GetImmut()->timeoutMs << " / " << limitsCopy.GetImmut()->timeoutMs
+              << " same snapshot: " << limitsCopy.SharesWith(limits)
+              << " detaches(Limits): " << CopyOnWritePtr<Limits>::DetachCount() << std::endl;
     return 0;
 }
@@ -0,0 +1,524 @@
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <atomic>
+#include <bitset>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+template<typename T>
+struct TraitCopyable {
+    TraitCopyable()
+    {
+        // 可以使用trait类模板和CRTP，对子类进行约束。
+        static_assert(std::copyable<T>);
+    }
+};
+
+#define DEFINE_TRAIT_CLASS(trait) \
+    namespace { \
+        using namespace std; \
+        template<typename T> \
+        struct CheckTrait##trait { \
+            CheckTrait##trait() \
+            { \
+                static_assert(trait<T>); \
+            } \
+        }; \
+    }
+    
+#define ENFORCE_TRAIT(trait, t) \
+    CheckTrait##trait<t>
+
+DEFINE_TRAIT_CLASS(copyable);
+
+/** 按类型划分的对象池。 */
+template<typename T>
+class ObjectPool {
+public:
+    /** */
+    static void *Allocate();
+    /** */
+    static void Deallocate(void *p) noexcept;
+
+private:
+    union Slot {
+        Slot *next;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    // 每个线程一条空闲链表，分配和回收都不需要原子操作或加锁。
+    // 在 A 线程分配、B 线程回收的块会留在 B 的链表中，这不影响正确性。
+    struct FreeList {
+        Slot *head = nullptr;
+        std::size_t size = 0;
+
+        ~FreeList()
+        {
+            while (head) {
+                Slot *next = head->next;
+                ::operator delete(head);
+                head = next;
+            }
+            Destroyed() = true;
+        }
+    };
+
+    // 静态或更长寿的 thread_local CopyOnWritePtr 可能在本线程的链表析构之后才释放块，
+    // 这时返回空，调用者直接使用全局堆。标志本身没有析构函数，线程结束前一直可以读。
+    static FreeList *Local() noexcept
+    {
+        if (Destroyed()) {
+            return nullptr;
+        }
+        thread_local FreeList list;
+        return &list;
+    }
+
+    static bool &Destroyed() noexcept
+    {
+        thread_local bool destroyed = false;
+        return destroyed;
+    }
+
+    // 超出上限的块直接还给全局堆，避免突发写入后长期占用内存。
+    static constexpr std::size_t kMaxCached = 1024;
+};
+
+template<typename T>
+void *ObjectPool<T>::Allocate()
+{
+    FreeList *list = Local();
+    if (Slot *slot = list ? list->head : nullptr) {
+        list->head = slot->next;
+        --list->size;
+        return slot;
+    }
+    return ::operator new(sizeof(Slot));
+}
+
+template<typename T>
+void ObjectPool<T>::Deallocate(void *p) noexcept
+{
+    FreeList *list = Local();
+    if (!list || list->size >= kMaxCached) {
+        ::operator delete(p);
+        return;
+    }
+    Slot *slot = static_cast<Slot *>(p);
+    slot->next = list->head;
+    list->head = slot;
+    ++list->size;
+}
+
+/** 全局唯一的版本戳。 */
+inline std::uint64_t NextCowStamp() noexcept
+{
+    // 每个线程从全局计数器批量领取一段，写路径上通常不会碰到共享的缓存行。
+    // 戳只保证唯一，不保证跨线程单调，所以只能用来判断相等。
+    constexpr std::uint64_t kBatch = 1024;
+    static std::atomic<std::uint64_t> next { 1 };
+    thread_local std::uint64_t cur = 0;
+    thread_local std::uint64_t end = 0;
+    if (cur == end) {
+        cur = next.fetch_add(kBatch, std::memory_order_relaxed);
+        end = cur + kBatch;
+    }
+    return cur++;
+}
+
+/** 字段级变更跟踪：T 声明 static constexpr std::size_t kTrackedFields = N 即可开启。 */
+template<typename T>
+constexpr std::size_t CowTrackedFields = 0;
+
+template<typename T>
+    requires requires { { T::kTrackedFields } -> std::convertible_to<std::size_t>; }
+constexpr std::size_t CowTrackedFields<T> = T::kTrackedFields;
+
+/** 内联存放的大小上限。 */
+inline constexpr std::size_t kCowInlineBytes = 4 * sizeof(void *);
+
+/**
+ * 小对象内联存放在 CopyOnWritePtr 里，复制时立即复制值：复制几十字节比维护原子
+ * 引用计数便宜，读取也省掉一次指针跳转。默认只对可平凡复制的小类型开启；
+ * 复制代价确实很小的其它类型（比如总是很短的 std::string）可以特化为 true。
+ */
+template<typename T>
+constexpr bool CowInlineStorage = std::is_trivially_copyable_v<T> && sizeof(T) <= kCowInlineBytes;
+
+template<std::copyable T>
+class CopyOnWritePtr
+    //: public TraitCopyable<CopyOnWritePtr<T>> {
+    : public ENFORCE_TRAIT(copyable, CopyOnWritePtr<T>) {
+    // 无法在这里直接约束CopyOnWritePtr类模板为某个concept，只有在实例化时方可约束。
+    // 因为CopyOnWritePtr这时是incomplete type
+    //static_assert(std::copyable<CopyOnWritePtr<T>>);
+    //static_assert(std::copyable<std::shared_ptr<T>>);
+public:
+    /** */
+    CopyOnWritePtr();
+    /** */
+    CopyOnWritePtr(const CopyOnWritePtr &robj) noexcept(kNothrowCopy);
+    /** */
+    CopyOnWritePtr(CopyOnWritePtr &&robj) noexcept;
+    /** */
+    template<typename... Ts>
+    CopyOnWritePtr(Ts... ts); // 注意：universal absorber when a ctor of certain form is not declared.
+    /** 数据块（包括之后 detach 出来的副本）都从 resource 分配；内联存放时不使用 resource。 */
+    template<typename... Ts>
+    CopyOnWritePtr(std::allocator_arg_t, std::pmr::memory_resource *resource, Ts... ts);
+    /** */
+    CopyOnWritePtr &operator=(const CopyOnWritePtr &robj) noexcept(kNothrowCopy);
+    /** */
+    CopyOnWritePtr &operator=(CopyOnWritePtr &&robj) noexcept;
+    /** */
+    ~CopyOnWritePtr();
+    
+    /** */
+    T *GetMut();
+    /** */
+    const T *GetImmut() const;
+
+    /** 只修改第 field 个字段，其它字段的版本保持不变。 */
+    T *GetMut(std::size_t field) requires (CowTrackedFields<T> > 0);
+
+    /** 每次 GetMut() 都会更新的版本戳；版本相同即内容相同。 */
+    std::uint64_t Version() const noexcept;
+    /** O(1)：两者是否仍共享同一份数据。内联存放时没有共享，比较的是版本戳，即内容是否仍然相同。 */
+    bool SharesWith(const CopyOnWritePtr &robj) const noexcept;
+    /** 相对于 base 快照修改过的字段，base 可以是任意更早（或无关）的拷贝。 */
+    std::bitset<CowTrackedFields<T>> ChangedFields(const CopyOnWritePtr &base) const
+        requires (CowTrackedFields<T> > 0);
+
+    /** 该类型累计发生的 detach（即写入时真正复制）次数。 */
+    static std::uint64_t DetachCount() noexcept;
+    
+private:
+    static constexpr bool kInline = CowInlineStorage<T>;
+    static constexpr bool kNothrowCopy = !kInline || std::is_nothrow_copy_constructible_v<T>;
+    static_assert(!kInline || std::is_nothrow_move_constructible_v<T>, "inline CopyOnWritePtr needs a noexcept move");
+
+    static constexpr std::size_t kFields = CowTrackedFields<T>;
+    struct NoFields { };
+    // 每个字段最后一次被修改时的版本戳，随 detach 一起复制。比较两份快照的
+    // 字段戳即可得出差异，不论它们之间经历了多少次 detach。
+    using FieldVersions = std::conditional_t<(kFields > 0), std::array<std::uint64_t, kFields>, NoFields>;
+
+    // 不用 std::shared_ptr：它的 use_count() 是 relaxed 读取，拿来判断独占
+    // 没有 acquire 语义。另一线程放弃所有权之前对共享对象的读，未必
+    // happens-before 本线程随后的就地修改。
+    struct Block {
+        template<typename... Ts>
+        explicit Block(Ts&&... ts)
+            : value(std::forward<Ts>(ts)...)
+        { }
+
+        std::atomic<long> refs { 1 };
+        // 为空表示来自按类型划分的对象池。
+        std::pmr::memory_resource *resource { nullptr };
+        // 只有独占者才会修改，共享期间只读，不需要原子操作。
+        std::uint64_t version { 0 };
+        [[no_unique_address]] FieldVersions fields {};
+        T value;
+    };
+
+    // 内联存放：与 Block 相同的字段，没有引用计数。
+    struct Inline {
+        template<typename... Ts>
+        explicit Inline(Ts&&... ts)
+            : value(std::forward<Ts>(ts)...)
+        {
+            if constexpr (kFields > 0) {
+                fields.fill(version);
+            }
+        }
+
+        std::uint64_t version { NextCowStamp() };
+        [[no_unique_address]] FieldVersions fields {};
+        T value;
+    };
+
+    using Storage = std::conditional_t<kInline, Inline, Block *>;
+
+    template<typename... Ts>
+    static Storage Make(std::pmr::memory_resource *resource, Ts&&... ts);
+    static Storage Take(CopyOnWritePtr &robj) noexcept;
+    template<typename... Ts>
+    static Block *Create(std::pmr::memory_resource *resource, Ts&&... ts);
+    static void Release(Block *block) noexcept;
+    static void Deallocate(std::pmr::memory_resource *resource, void *mem) noexcept;
+
+    /** 两种存放方式下都有 version、fields、value；移动后的堆存放为空。 */
+    auto *State() noexcept;
+    const auto *State() const noexcept;
+
+    /** */
+    void detach();
+
+private:
+    Storage data_;
+
+    static inline std::atomic<std::uint64_t> detaches_ { 0 };
+};
+
+template<std::copyable T>
+CopyOnWritePtr<T>::CopyOnWritePtr()
+    : data_{Make(nullptr)}
+{
+}
+
+template<std::copyable T>
+CopyOnWritePtr<T>::CopyOnWritePtr(const CopyOnWritePtr &robj) noexcept(kNothrowCopy)
+    : data_{robj.data_}
+{
+    if constexpr (!kInline) {
+        if (data_) {
+            // 增加引用只需要原子性；新的拥有者必然是从已有拥有者处复制而来。
+            data_->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+template<std::copyable T>
+CopyOnWritePtr<T>::CopyOnWritePtr(CopyOnWritePtr &&robj) noexcept
+    : data_{Take(robj)}
+{
+}
+
+template<std::copyable T>
+template<typename... Ts>
+CopyOnWritePtr<T>::CopyOnWritePtr(Ts... ts)
+    : data_{Make(nullptr, std::move(ts)...)}
+{
+}
+
+template<std::copyable T>
+template<typename... Ts>
+CopyOnWritePtr<T>::CopyOnWritePtr(std::allocator_arg_t, std::pmr::memory_resource *resource, Ts... ts)
+    : data_{Make(resource, std::move(ts)...)}
+{
+}
+
+template<std::copyable T>
+CopyOnWritePtr<T> &CopyOnWritePtr<T>::operator=(const CopyOnWritePtr &robj) noexcept(kNothrowCopy)
+{
+    CopyOnWritePtr tmp { robj };
+    std::swap(data_, tmp.data_);
+    return *this;
+}
+
+template<std::copyable T>
+CopyOnWritePtr<T> &CopyOnWritePtr<T>::operator=(CopyOnWritePtr &&robj) noexcept
+{
+    CopyOnWritePtr tmp { std::move(robj) };
+    std::swap(data_, tmp.data_);
+    return *this;
+}
+
+template<std::copyable T>
+CopyOnWritePtr<T>::~CopyOnWritePtr()
+{
+    if constexpr (!kInline) {
+        if (data_) {
+            Release(data_);
+        }
+    }
+}
+
+template<std::copyable T>
+T *CopyOnWritePtr<T>::GetMut()
+{
+    detach();
+    auto *state = State();
+    if (!state) {
+        return nullptr;
+    }
+    // 不知道调用者会改哪个字段，只能保守地认为全部都改了。
+    const std::uint64_t stamp = NextCowStamp();
+    if constexpr (kFields > 0) {
+        state->fields.fill(stamp);
+    }
+    state->version = stamp;
+    return &state->value;
+}
+
+template<std::copyable T>
+T *CopyOnWritePtr<T>::GetMut(std::size_t field) requires (CowTrackedFields<T> > 0)
+{
+    assert(field < kFields);
+    detach();
+    auto *state = State();
+    if (!state) {
+        return nullptr;
+    }
+    const std::uint64_t stamp = NextCowStamp();
+    state->fields[field] = stamp;
+    state->version = stamp;
+    return &state->value;
+}
+
+template<std::copyable T>
+const T *CopyOnWritePtr<T>::GetImmut() const
+{
+    const auto *state = State();
+    return state ? &state->value : nullptr;
+}
+
+template<std::copyable T>
+std::uint64_t CopyOnWritePtr<T>::Version() const noexcept
+{
+    const auto *state = State();
+    return state ? state->version : 0;
+}
+
+template<std::copyable T>
+bool CopyOnWritePtr<T>::SharesWith(const CopyOnWritePtr &robj) const noexcept
+{
+    if constexpr (kInline) {
+        return data_.version == robj.data_.version;
+    } else {
+        return data_ == robj.data_;
+    }
+}
+
+template<std::copyable T>
+std::bitset<CowTrackedFields<T>> CopyOnWritePtr<T>::ChangedFields(const CopyOnWritePtr &base) const
+    requires (CowTrackedFields<T> > 0)
+{
+    std::bitset<kFields> changed;
+    if (SharesWith(base)) {
+        return changed;
+    }
+    const auto *state = State();
+    const auto *baseState = base.State();
+    if (!state || !baseState) {
+        return changed.set();
+    }
+    for (std::size_t i = 0; i < kFields; ++i) {
+        changed[i] = state->fields[i] != baseState->fields[i];
+    }
+    return changed;
+}
+
+template<std::copyable T>
+std::uint64_t CopyOnWritePtr<T>::DetachCount() noexcept
+{
+    return detaches_.load(std::memory_order_relaxed);
+}
+
+template<std::copyable T>
+template<typename... Ts>
+typename CopyOnWritePtr<T>::Storage CopyOnWritePtr<T>::Make(std::pmr::memory_resource *resource, Ts&&... ts)
+{
+    if constexpr (kInline) {
+        return Inline(std::forward<Ts>(ts)...);
+    } else {
+        return Create(resource, std::forward<Ts>(ts)...);
+    }
+}
+
+template<std::copyable T>
+typename CopyOnWritePtr<T>::Storage CopyOnWritePtr<T>::Take(CopyOnWritePtr &robj) noexcept
+{
+    if constexpr (kInline) {
+        Storage taken { std::move(robj.data_) };
+        if constexpr (!std::is_trivially_copyable_v<T>) {
+            // 被移动后的值变了，不能再与原来的快照版本相同。
+            robj.data_.version = NextCowStamp();
+            if constexpr (kFields > 0) {
+                robj.data_.fields.fill(robj.data_.version);
+            }
+        }
+        return taken;
+    } else {
+        return std::exchange(robj.data_, nullptr);
+    }
+}
+
+template<std::copyable T>
+template<typename... Ts>
+typename CopyOnWritePtr<T>::Block *CopyOnWritePtr<T>::Create(std::pmr::memory_resource *resource, Ts&&... ts)
+{
+    void *mem = resource ? resource->allocate(sizeof(Block), alignof(Block)) : ObjectPool<Block>::Allocate();
+    try {
+        Block *block = ::new (mem) Block(std::forward<Ts>(ts)...);
+        block->resource = resource;
+        // 新构造的对象与任何已有快照都不相同。
+        block->version = NextCowStamp();
+        if constexpr (kFields > 0) {
+            block->fields.fill(block->version);
+        }
+        return block;
+    } catch (...) {
+        Deallocate(resource, mem);
+        throw;
+    }
+}
+
+template<std::copyable T>
+void CopyOnWritePtr<T>::Release(Block *block) noexcept
+{
+    // release：本线程对共享对象的读写在归还所有权之前完成；
+    // acquire：最后一个拥有者析构之前能看到其它拥有者的所有操作。
+    if (block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        std::pmr::memory_resource *resource = block->resource;
+        block->~Block();
+        Deallocate(resource, block);
+    }
+}
+
+template<std::copyable T>
+void CopyOnWritePtr<T>::Deallocate(std::pmr::memory_resource *resource, void *mem) noexcept
+{
+    if (resource) {
+        resource->deallocate(mem, sizeof(Block), alignof(Block));
+    } else {
+        ObjectPool<Block>::Deallocate(mem);
+    }
+}
+
+template<std::copyable T>
+auto *CopyOnWritePtr<T>::State() noexcept
+{
+    if constexpr (kInline) {
+        return &data_;
+    } else {
+        return data_;
+    }
+}
+
+template<std::copyable T>
+const auto *CopyOnWritePtr<T>::State() const noexcept
+{
+    if constexpr (kInline) {
+        return &data_;
+    } else {
+        return static_cast<const Block *>(data_);
+    }
+}
+
+template<std::copyable T>
+void CopyOnWritePtr<T>::detach()
+{
+    // 只有在 acquire 读到计数为 1 时才能就地修改：之前的拥有者都已经以
+    // release 语义放弃所有权，它们对共享对象的访问都 happens-before 这里。
+    // 两个线程同时看到计数为 2 时都会复制一份，多一次复制但结果正确。
+    if constexpr (!kInline) {
+        if (data_ && data_->refs.load(std::memory_order_acquire) > 1) {
+            Block *copy = Create(data_->resource, std::as_const(data_->value));
+            // 副本继承来源的版本，随后 GetMut() 更新版本时才会把它与来源区分开。
+            copy->version = data_->version;
+            copy->fields = data_->fields;
+            Release(data_);
+            data_ = copy;
+            detaches_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
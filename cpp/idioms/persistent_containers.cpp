@@ -0,0 +1,614 @@
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "copy_on_write.hpp"
+
+// 持久化（structural sharing）容器。
+// 节点之间通过 CopyOnWritePtr 共享：一次写入沿着根到叶子的路径逐层 GetMut()，
+// 只有仍被其它版本共享的节点才会 detach，所以每次写入只复制 O(log n) 个节点。
+// 同一套机制天然就是 transient：一个独占的版本中，刚复制出来的路径引用计数
+// 为 1，后续写入直接就地修改，批量编辑不会重复复制。
+
+/** 定长基数树（radix-balanced trie），PersistentVector/TransientVector 的公共实现。 */
+template<std::copyable T>
+class RadixTrie {
+public:
+    static constexpr unsigned kBits = 5;
+    static constexpr std::size_t kBranch = std::size_t{1} << kBits;
+    static constexpr std::size_t kMask = kBranch - 1;
+
+    /** */
+    std::size_t Size() const { return size_; }
+    /** */
+    const T &Get(std::size_t i) const;
+    /** */
+    void Set(std::size_t i, T value);
+    /** */
+    void PushBack(T value);
+    /** */
+    void PopBack();
+
+    /** */
+    template<typename Fn>
+    void ForEach(Fn &&fn) const { ForEach(*root_.GetImmut(), shift_, fn); }
+
+    /** 节点的累计复制次数，用来观察每次写入复制了多少路径节点。 */
+    static std::uint64_t NodeCopies() { return CopyOnWritePtr<Node>::DetachCount(); }
+
+private:
+    struct Child;
+    struct Node {
+        std::vector<Child> children; // 内部节点
+        std::vector<T> values;       // 叶子节点
+    };
+    // 单独包一层：Node 定义完整之后才能实例化 CopyOnWritePtr<Node> 的 copyable 约束。
+    struct Child {
+        CopyOnWritePtr<Node> ptr;
+    };
+
+    /** 成功弹出后返回该子树是否已经为空。 */
+    static bool PopBack(Node &node, unsigned shift, std::size_t i);
+
+    template<typename Fn>
+    static void ForEach(const Node &node, unsigned shift, Fn &fn);
+
+private:
+    CopyOnWritePtr<Node> root_;
+    std::size_t size_ { 0 };
+    unsigned shift_ { 0 };
+};
+
+template<std::copyable T>
+const T &RadixTrie<T>::Get(std::size_t i) const
+{
+    assert(i < size_);
+    const Node *node = root_.GetImmut();
+    for (unsigned level = shift_; level > 0; level -= kBits) {
+        node = node->children[(i >> level) & kMask].ptr.GetImmut();
+    }
+    return node->values[i & kMask];
+}
+
+template<std::copyable T>
+void RadixTrie<T>::Set(std::size_t i, T value)
+{
+    assert(i < size_);
+    Node *node = root_.GetMut();
+    for (unsigned level = shift_; level > 0; level -= kBits) {
+        node = node->children[(i >> level) & kMask].ptr.GetMut();
+    }
+    node->values[i & kMask] = std::move(value);
+}
+
+template<std::copyable T>
+void RadixTrie<T>::PushBack(T value)
+{
+    if (size_ == (kBranch << shift_)) {
+        // 根已满，长高一层；旧根成为新根的第一个孩子，不需要复制。
+        Node root;
+        root.children.push_back(Child { std::move(root_) });
+        root_ = CopyOnWritePtr<Node>(std::move(root));
+        shift_ += kBits;
+    }
+
+    const std::size_t i = size_;
+    Node *node = root_.GetMut();
+    for (unsigned level = shift_; level > 0; level -= kBits) {
+        const std::size_t idx = (i >> level) & kMask;
+        if (idx == node->children.size()) {
+            node->children.push_back(Child {});
+        }
+        node = node->children[idx].ptr.GetMut();
+    }
+    node->values.push_back(std::move(value));
+    ++size_;
+}
+
+template<std::copyable T>
+void RadixTrie<T>::PopBack()
+{
+    assert(size_ > 0);
+    PopBack(*root_.GetMut(), shift_, --size_);
+    // 根只剩一个孩子时降低一层，保持 Get() 的路径最短。
+    while (shift_ > 0 && root_.GetImmut()->children.size() == 1) {
+        CopyOnWritePtr<Node> child = root_.GetImmut()->children.front().ptr;
+        root_ = std::move(child);
+        shift_ -= kBits;
+    }
+}
+
+template<std::copyable T>
+bool RadixTrie<T>::PopBack(Node &node, unsigned shift, std::size_t i)
+{
+    if (shift == 0) {
+        node.values.pop_back();
+        return node.values.empty();
+    }
+    const std::size_t idx = (i >> shift) & kMask;
+    if (PopBack(*node.children[idx].ptr.GetMut(), shift - kBits, i)) {
+        node.children.pop_back();
+    }
+    return node.children.empty();
+}
+
+template<std::copyable T>
+template<typename Fn>
+void RadixTrie<T>::ForEach(const Node &node, unsigned shift, Fn &fn)
+{
+    if (shift == 0) {
+        for (const T &v : node.values) {
+            fn(v);
+        }
+        return;
+    }
+    for (const Child &c : node.children) {
+        ForEach(*c.ptr.GetImmut(), shift - kBits, fn);
+    }
+}
+
+template<std::copyable T>
+class PersistentVector;
+
+/** 批量编辑用的可变版本；与来源共享节点，只在第一次写到某条路径时复制。 */
+template<std::copyable T>
+class TransientVector {
+public:
+    /** */
+    std::size_t Size() const { return trie_.Size(); }
+    /** */
+    const T &operator[](std::size_t i) const { return trie_.Get(i); }
+    /** */
+    void Set(std::size_t i, T value) { trie_.Set(i, std::move(value)); }
+    /** */
+    void PushBack(T value) { trie_.PushBack(std::move(value)); }
+    /** */
+    void PopBack() { trie_.PopBack(); }
+    /** 冻结为持久版本，transient 本身随之失效。 */
+    PersistentVector<T> Persistent() &&;
+
+private:
+    friend class PersistentVector<T>;
+    explicit TransientVector(const RadixTrie<T> &trie) : trie_ { trie } { }
+
+    RadixTrie<T> trie_;
+};
+
+/** 不可变向量：每个修改操作返回新版本，新旧版本共享未改动的节点。 */
+template<std::copyable T>
+class PersistentVector {
+public:
+    /** */
+    PersistentVector() = default;
+
+    /** */
+    std::size_t Size() const { return trie_.Size(); }
+    /** */
+    const T &operator[](std::size_t i) const { return trie_.Get(i); }
+    /** */
+    template<typename Fn>
+    void ForEach(Fn &&fn) const { trie_.ForEach(std::forward<Fn>(fn)); }
+
+    /** */
+    [[nodiscard]] PersistentVector Set(std::size_t i, T value) const;
+    /** */
+    [[nodiscard]] PersistentVector PushBack(T value) const;
+    /** */
+    [[nodiscard]] PersistentVector PopBack() const;
+    /** */
+    TransientVector<T> Transient() const { return TransientVector<T> { trie_ }; }
+
+    /** */
+    static std::uint64_t NodeCopies() { return RadixTrie<T>::NodeCopies(); }
+
+private:
+    friend class TransientVector<T>;
+    explicit PersistentVector(RadixTrie<T> &&trie) : trie_ { std::move(trie) } { }
+
+    RadixTrie<T> trie_;
+};
+
+template<std::copyable T>
+PersistentVector<T> TransientVector<T>::Persistent() &&
+{
+    return PersistentVector<T> { std::move(trie_) };
+}
+
+template<std::copyable T>
+PersistentVector<T> PersistentVector<T>::Set(std::size_t i, T value) const
+{
+    auto t = Transient();
+    t.Set(i, std::move(value));
+    return std::move(t).Persistent();
+}
+
+template<std::copyable T>
+PersistentVector<T> PersistentVector<T>::PushBack(T value) const
+{
+    auto t = Transient();
+    t.PushBack(std::move(value));
+    return std::move(t).Persistent();
+}
+
+template<std::copyable T>
+PersistentVector<T> PersistentVector<T>::PopBack() const
+{
+    auto t = Transient();
+    t.PopBack();
+    return std::move(t).Persistent();
+}
+
+/** 哈希数组映射树（HAMT，CHAMP 布局），PersistentMap/TransientMap 的公共实现。 */
+template<std::copyable K, std::copyable V, typename Hash = std::hash<K>>
+class HashTrie {
+public:
+    static constexpr unsigned kBits = 5;
+    static constexpr unsigned kHashBits = 64;
+
+    /** */
+    std::size_t Size() const { return size_; }
+    /** */
+    const V *Find(const K &key) const;
+    /** 返回是否插入了新键；已有的键则覆盖其值。 */
+    bool Set(K key, V value);
+    /** 返回是否删除了键。 */
+    bool Erase(const K &key);
+
+    /** */
+    template<typename Fn>
+    void ForEach(Fn &&fn) const { ForEach(*root_.GetImmut(), fn); }
+
+    /** */
+    static std::uint64_t NodeCopies() { return CopyOnWritePtr<Node>::DetachCount(); }
+
+private:
+    using Entry = std::pair<K, V>;
+
+    struct Child;
+    // 条目和子节点分开存放，各自按位图中的位序排列。
+    // 哈希位用完的节点（shift >= kHashBits）是冲突桶，只用 data 线性存放。
+    struct Node {
+        std::uint32_t dataMap = 0;
+        std::uint32_t nodeMap = 0;
+        std::vector<Entry> data;
+        std::vector<Child> nodes;
+    };
+    struct Child {
+        CopyOnWritePtr<Node> ptr;
+    };
+
+    static std::uint64_t HashOf(const K &key);
+    static std::uint32_t BitOf(std::uint64_t h, unsigned shift)
+    {
+        return std::uint32_t{1} << ((h >> shift) & 0x1f);
+    }
+    static std::size_t IndexOf(std::uint32_t map, std::uint32_t bit)
+    {
+        return std::popcount(map & (bit - 1));
+    }
+
+    static Node MergeTwo(Entry e1, std::uint64_t h1, Entry e2, std::uint64_t h2, unsigned shift);
+    static bool Set(Node &node, unsigned shift, std::uint64_t h, K &key, V &value);
+    static bool Erase(Node &node, unsigned shift, std::uint64_t h, const K &key);
+
+    template<typename Fn>
+    static void ForEach(const Node &node, Fn &fn);
+
+private:
+    CopyOnWritePtr<Node> root_;
+    std::size_t size_ { 0 };
+};
+
+template<std::copyable K, std::copyable V, typename Hash>
+std::uint64_t HashTrie<K, V, Hash>::HashOf(const K &key)
+{
+    // std::hash 对整数通常是恒等映射，先做一次混合（splitmix64 终结器），
+    // 让每一层的 5 个比特都足够均匀。
+    std::uint64_t h = Hash {}(key);
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebull;
+    h ^= h >> 31;
+    return h;
+}
+
+template<std::copyable K, std::copyable V, typename Hash>
+const V *HashTrie<K, V, Hash>::Find(const K &key) const
+{
+    const std::uint64_t h = HashOf(key);
+    const Node *node = root_.GetImmut();
+    for (unsigned shift = 0; ; shift += kBits) {
+        if (shift >= kHashBits) {
+            for (const Entry &e : node->data) {
+                if (e.first == key) {
+                    return &e.second;
+                }
+            }
+            return nullptr;
+        }
+        const std::uint32_t bit = BitOf(h, shift);
+        if (node->dataMap & bit) {
+            const Entry &e = node->data[IndexOf(node->dataMap, bit)];
+            return e.first == key ? &e.second : nullptr;
+        }
+        if (!(node->nodeMap & bit)) {
+            return nullptr;
+        }
+        node = node->nodes[IndexOf(node->nodeMap, bit)].ptr.GetImmut();
+    }
+}
+
+template<std::copyable K, std::copyable V, typename Hash>
+bool HashTrie<K, V, Hash>::Set(K key, V value)
+{
+    const bool inserted = Set(*root_.GetMut(), 0, HashOf(key), key, value);
+    size_ += inserted;
+    return inserted;
+}
+
+template<std::copyable K, std::copyable V, typename Hash>
+bool HashTrie<K, V, Hash>::Erase(const K &key)
+{
+    // 先只读地确认键存在，避免对不存在的键做无谓的路径复制。
+    if (!Find(key)) {
+        return false;
+    }
+    Erase(*root_.GetMut(), 0, HashOf(key), key);
+    --size_;
+    return true;
+}
+
+template<std::copyable K, std::copyable V, typename Hash>
+typename HashTrie<K, V, Hash>::Node
+HashTrie<K, V, Hash>::MergeTwo(Entry e1, std::uint64_t h1, Entry e2, std::uint64_t h2, unsigned shift)
+{
+    Node node;
+    if (shift >= kHashBits) {
+        node.data.push_back(std::move(e1));
+        node.data.push_back(std::move(e2));
+        return node;
+    }
+    const std::uint32_t b1 = BitOf(h1, shift);
+    const std::uint32_t b2 = BitOf(h2, shift);
+    if (b1 == b2) {
+        node.nodeMap = b1;
+        node.nodes.push_back(Child { CopyOnWritePtr<Node>(
+            MergeTwo(std::move(e1), h1, std::move(e2), h2, shift + kBits)) });
+        return node;
+    }
+    node.dataMap = b1 | b2;
+    if (b1 < b2) {
+        node.data.push_back(std::move(e1));
+        node.data.push_back(std::move(e2));
+    } else {
+        node.data.push_back(std::move(e2));
+        node.data.push_back(std::move(e1));
+    }
+    return node;
+}
+
+template<std::copyable K, std::copyable V, typename Hash>
+bool HashTrie<K, V, Hash>::Set(Node &node, unsigned shift, std::uint64_t h, K &key, V &value)
+{
+    if (shift >= kHashBits) {
+        for (Entry &e : node.data) {
+            if (e.first == key) {
+                e.second = std::move(value);
+                return false;
+            }
+        }
+        node.data.emplace_back(std::move(key), std::move(value));
+        return true;
+    }
+
+    const std::uint32_t bit = BitOf(h, shift);
+    if (node.dataMap & bit) {
+        const std::size_t idx = IndexOf(node.dataMap, bit);
+        if (node.data[idx].first == key) {
+            node.data[idx].second = std::move(value);
+            return false;
+        }
+        // 同一个槽位上已有别的键：把两个条目一起下沉到新的子节点。
+        Entry old = std::move(node.data[idx]);
+        const std::uint64_t oldHash = HashOf(old.first);
+        node.data.erase(node.data.begin() + idx);
+        node.dataMap ^= bit;
+        node.nodeMap |= bit;
+        node.nodes.insert(node.nodes.begin() + IndexOf(node.nodeMap, bit), Child { CopyOnWritePtr<Node>(
+            MergeTwo(std::move(old), oldHash, Entry { std::move(key), std::move(value) }, h, shift + kBits)) });
+        return true;
+    }
+    if (node.nodeMap & bit) {
+        return Set(*node.nodes[IndexOf(node.nodeMap, bit)].ptr.GetMut(), shift + kBits, h, key, value);
+    }
+    node.dataMap |= bit;
+    node.data.emplace(node.data.begin() + IndexOf(node.dataMap, bit), std::move(key), std::move(value));
+    return true;
+}
+
+template<std::copyable K, std::copyable V, typename Hash>
+bool HashTrie<K, V, Hash>::Erase(Node &node, unsigned shift, std::uint64_t h, const K &key)
+{
+    if (shift >= kHashBits) {
+        for (auto it = node.data.begin(); it != node.data.end(); ++it) {
+            if (it->first == key) {
+                node.data.erase(it);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const std::uint32_t bit = BitOf(h, shift);
+    if (node.dataMap & bit) {
+        const std::size_t idx = IndexOf(node.dataMap, bit);
+        if (!(node.data[idx].first == key)) {
+            return false;
+        }
+        node.data.erase(node.data.begin() + idx);
+        node.dataMap ^= bit;
+        return true;
+    }
+    if (!(node.nodeMap & bit)) {
+        return false;
+    }
+
+    const std::size_t nidx = IndexOf(node.nodeMap, bit);
+    Node &child = *node.nodes[nidx].ptr.GetMut();
+    if (!Erase(child, shift + kBits, h, key)) {
+        return false;
+    }
+    // 维持规范形态：子节点只剩一个条目时把它提升上来，空子节点直接删除。
+    if (child.nodes.empty() && child.data.size() <= 1) {
+        if (child.data.size() == 1) {
+            Entry last = std::move(child.data.front());
+            node.dataMap |= bit;
+            node.data.insert(node.data.begin() + IndexOf(node.dataMap, bit), std::move(last));
+        }
+        node.nodes.erase(node.nodes.begin() + nidx);
+        node.nodeMap ^= bit;
+    }
+    return true;
+}
+
+template<std::copyable K, std::copyable V, typename Hash>
+template<typename Fn>
+void HashTrie<K, V, Hash>::ForEach(const Node &node, Fn &fn)
+{
+    for (const Entry &e : node.data) {
+        fn(e.first, e.second);
+    }
+    for (const Child &c : node.nodes) {
+        ForEach(*c.ptr.GetImmut(), fn);
+    }
+}
+
+template<std::copyable K, std::copyable V, typename Hash = std::hash<K>>
+class PersistentMap;
+
+/** 批量编辑用的可变映射。 */
+template<std::copyable K, std::copyable V, typename Hash = std::hash<K>>
+class TransientMap {
+public:
+    /** */
+    std::size_t Size() const { return trie_.Size(); }
+    /** */
+    const V *Find(const K &key) const { return trie_.Find(key); }
+    /** */
+    bool Set(K key, V value) { return trie_.Set(std::move(key), std::move(value)); }
+    /** */
+    bool Erase(const K &key) { return trie_.Erase(key); }
+    /** 冻结为持久版本，transient 本身随之失效。 */
+    PersistentMap<K, V, Hash> Persistent() &&;
+
+private:
+    friend class PersistentMap<K, V, Hash>;
+    explicit TransientMap(const HashTrie<K, V, Hash> &trie) : trie_ { trie } { }
+
+    HashTrie<K, V, Hash> trie_;
+};
+
+/** 不可变映射：每个修改操作返回新版本，新旧版本共享未改动的节点。 */
+template<std::copyable K, std::copyable V, typename Hash>
+class PersistentMap {
+public:
+    /** */
+    PersistentMap() = default;
+
+    /** */
+    std::size_t Size() const { return trie_.Size(); }
+    /** */
+    const V *Find(const K &key) const { return trie_.Find(key); }
+    /** */
+    template<typename Fn>
+    void ForEach(Fn &&fn) const { trie_.ForEach(std::forward<Fn>(fn)); }
+
+    /** */
+    [[nodiscard]] PersistentMap Set(K key, V value) const;
+    /** */
+    [[nodiscard]] PersistentMap Erase(const K &key) const;
+    /** */
+    TransientMap<K, V, Hash> Transient() const { return TransientMap<K, V, Hash> { trie_ }; }
+
+    /** */
+    static std::uint64_t NodeCopies() { return HashTrie<K, V, Hash>::NodeCopies(); }
+
+private:
+    friend class TransientMap<K, V, Hash>;
+    explicit PersistentMap(HashTrie<K, V, Hash> &&trie) : trie_ { std::move(trie) } { }
+
+    HashTrie<K, V, Hash> trie_;
+};
+
+template<std::copyable K, std::copyable V, typename Hash>
+PersistentMap<K, V, Hash> TransientMap<K, V, Hash>::Persistent() &&
+{
+    return PersistentMap<K, V, Hash> { std::move(trie_) };
+}
+
+template<std::copyable K, std::copyable V, typename Hash>
+PersistentMap<K, V, Hash> PersistentMap<K, V, Hash>::Set(K key, V value) const
+{
+    auto t = Transient();
+    t.Set(std::move(key), std::move(value));
+    return std::move(t).Persistent();
+}
+
+template<std::copyable K, std::copyable V, typename Hash>
+PersistentMap<K, V, Hash> PersistentMap<K, V, Hash>::Erase(const K &key) const
+{
+    if (!Find(key)) {
+        return *this;
+    }
+    auto t = Transient();
+    t.Erase(key);
+    return std::move(t).Persistent();
+}
+
+int main(int argc, const char *argv[])
+{
+    constexpr std::size_t kCount = 1 << 20;
+
+    // transient 批量构建：每个节点只在创建时分配一次，之后都是就地修改。
+    auto builder = PersistentVector<int>{}.Transient();
+    for (std::size_t i = 0; i < kCount; ++i) {
+        builder.PushBack(static_cast<int>(i));
+    }
+    const PersistentVector<int> v0 = std::move(builder).Persistent();
+
+    auto copies = PersistentVector<int>::NodeCopies();
+    const PersistentVector<int> v1 = v0.Set(12345, -1);
+    std::cout << "v0[12345]: " << v0[12345] << " v1[12345]: " << v1[12345] << std::endl;
+    std::cout << "node copies per write: " << PersistentVector<int>::NodeCopies() - copies
+              << " (size " << v1.Size() << ")" << std::endl;
+
+    const PersistentVector<int> v2 = v1.PopBack().PushBack(7);
+    std::cout << "v1.back: " << v1[kCount - 1] << " v2.back: " << v2[kCount - 1] << std::endl;
+
+    PersistentMap<std::string, int> m0;
+    {
+        auto t = m0.Transient();
+        for (int i = 0; i < 10000; ++i) {
+            t.Set("key" + std::to_string(i), i);
+        }
+        m0 = std::move(t).Persistent();
+    }
+    copies = PersistentMap<std::string, int>::NodeCopies();
+    const auto m1 = m0.Set("key42", 4242).Erase("key7");
+    std::cout << "map node copies for two writes: " << PersistentMap<std::string, int>::NodeCopies() - copies << std::endl;
+    std::cout << "m0[key42]: " << *m0.Find("key42") << " m1[key42]: " << *m1.Find("key42") << std::endl;
+    std::cout << "m0 size: " << m0.Size() << " m1 size: " << m1.Size()
+              << " m1 has key7: " << (m1.Find("key7") != nullptr) << std::endl;
+
+    std::size_t sum = 0;
+    m1.ForEach([&sum](const std::string &, int v) { sum += v; });
+    std::cout << "m1 sum: " << sum << std::endl;
+    return 0;
+}
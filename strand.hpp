@@ -0,0 +1,248 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// 串行执行器：投递到同一个 strand 的任务按 FIFO 顺序、互不并发地在线程池上执行。
+/**
+ * 不持有任何锁，也不会让 worker 等待：
+ * - 任务进入一个无锁的多生产者单消费者（Vyukov）侵入式队列；
+ * - pending_ 从 0 变为 1 的那个生产者负责向线程池投递一次 drain；
+ * - drain 在一个 worker 上连续执行最多 batch 个任务，还有剩余就重新投递自己，
+ *   让出 worker 给其它 strand，保证公平。drain 用 defer() 投递，不受线程池准入控制。
+ * 任意时刻最多只有一个 drain 在运行，所以同一 strand 的任务天然串行。
+ *
+ * 析构时等待已投递的任务全部执行完（见 wait_idle()），线程池此时必须还在运行。
+ * 任务抛出的异常在收尾之后重新抛给线程池（thread_pool 交给 on_exception），
+ * 不影响同一 strand 上后面的任务。
+ */
+template<typename Pool>
+class strand
+{
+public:
+  ///
+  explicit strand(Pool& pool, std::size_t batch = 64)
+    : pool_ {pool}
+    , batch_ {batch}
+    , head_ {&stub_}
+    , tail_ {&stub_}
+  {
+    assert(batch >= 1u);
+  }
+
+  strand(const strand&) = delete;
+  strand& operator=(const strand&) = delete;
+
+  ///
+  ~strand()
+  {
+    wait_idle();
+    assert(pending_.load() == 0);
+  }
+
+  /// 等待已投递的任务全部执行完，并且 drain 不再访问 strand。
+  /**
+   * submit() 的 future 就绪时 drain 还要做收尾（释放节点、递减计数、可能重新投递），
+   * 等 future 之后直接析构 strand 会让收尾访问已经释放的内存，所以析构前先调用本函数。
+   * 不能在本 strand 的任务里调用，那样它会等待自己。
+   */
+  void wait_idle()
+  {
+    auto lock = std::unique_lock {mutex_};
+    idle_.wait(lock, [this]() { return pending_.load(std::memory_order_acquire) == 0; });
+  }
+
+  /// 投递任务，不返回结果。
+  void post(std::function<void()> fn)
+  {
+    auto n = new node {std::move(fn)};
+    push(n);
+    // 第一个让队列变为非空的生产者负责调度；其余生产者直接返回。
+    if (pending_.fetch_add(1, std::memory_order_acq_rel) == 0) {
+      pool_.defer([this]() { drain(); });
+    }
+  }
+
+  /// 投递任务并返回 future。
+  template<typename Fn, typename... Args>
+  auto submit(Fn&& f, Args... args)
+  {
+    using return_type = std::invoke_result_t<Fn, Args...>;
+    auto ptask = std::make_shared<std::packaged_task<return_type()>>(
+        std::bind(std::forward<Fn>(f), std::forward<Args>(args)...));
+    auto future = ptask->get_future();
+    post([ptask]() { (*ptask)(); });
+    return future;
+  }
+
+private:
+  struct node
+  {
+    std::function<void()> fn;
+    std::atomic<node*> next {nullptr};
+  };
+
+  /// 多生产者入队：一次 exchange，再把前驱链接到自己。
+  void push(node* n)
+  {
+    n->next.store(nullptr, std::memory_order_relaxed);
+    node* prev = head_.exchange(n, std::memory_order_acq_rel);
+    prev->next.store(n, std::memory_order_release);
+  }
+
+  /// 单消费者出队，只在 drain 中调用。调用前已由 pending_ 确认至少有一个任务。
+  node* pop()
+  {
+    for (;;) {
+      node* tail = tail_;
+      node* next = tail->next.load(std::memory_order_acquire);
+      if (tail == &stub_) {
+        if (!next) {
+          // 生产者已经 exchange 了 head_ 但还没来得及链接 next，
+          // 两条指令之间的窗口，短暂让步即可。
+          std::this_thread::yield();
+          continue;
+        }
+        tail_ = next;
+        tail = next;
+        next = next->next.load(std::memory_order_acquire);
+      }
+      if (next) {
+        tail_ = next;
+        return tail;
+      }
+      if (tail != head_.load(std::memory_order_acquire)) {
+        // 同上，后继正在链接中。
+        std::this_thread::yield();
+        continue;
+      }
+      // tail 是最后一个节点：把 stub 放回队尾，之后 tail 就有了后继。
+      push(&stub_);
+      next = tail->next.load(std::memory_order_acquire);
+      if (next) {
+        tail_ = next;
+        return tail;
+      }
+      std::this_thread::yield();
+    }
+  }
+
+  void drain()
+  {
+    std::exception_ptr error;
+    for (std::size_t i = 0; i < batch_ && !error; ++i) {
+      node* n = pop();
+      try {
+        n->fn();
+      } catch (...) {
+        // 先做完收尾，否则节点泄漏、pending_ 永远不归零，strand 从此卡住。
+        error = std::current_exception();
+      }
+      delete n;
+      if (release()) {
+        if (error) {
+          std::rethrow_exception(error);
+        }
+        return;
+      }
+    }
+    // 还有任务：重新排到线程池队尾，而不是霸占当前 worker。
+    pool_.defer([this]() { drain(); });
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  /// 完成一个任务，返回 strand 是否因此变为空闲。返回 true 之后调用者不能再访问 this。
+  /**
+   * pending_ 只在持锁时降到 0：wait_idle() 持锁看到 0 时，这里已经释放了锁，
+   * 之后不再访问 strand。不会降到 0 的递减仍然是无锁的。
+   */
+  bool release()
+  {
+    auto pending = pending_.load(std::memory_order_relaxed);
+    while (pending > 1) {
+      if (pending_.compare_exchange_weak(pending, pending - 1, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+        return false;
+      }
+    }
+    auto lock = std::lock_guard {mutex_};
+    if (pending_.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+      return false;
+    }
+    idle_.notify_all();
+    return true;
+  }
+
+private:
+  Pool& pool_;
+  std::size_t batch_;
+  // 生产者之间只竞争 head_，消费者独占 tail_，各放一个缓存行。
+  alignas(64) std::atomic<node*> head_;
+  alignas(64) node* tail_;
+  node stub_;
+  alignas(64) std::atomic<std::size_t> pending_ {0};
+  // 只用于 wait_idle()。
+  std::mutex mutex_;
+  std::condition_variable idle_;
+};
+
+/// 按键串行的执行器：同一个键的任务 FIFO 且互不并发，不同的键并行执行。
+/**
+ * 键哈希到固定数量的 strand 上，不需要为每个键创建/回收 strand。
+ * 哈希到同一个 strand 的不同键也会被串行化，strand 数量应远大于 worker 数。
+ * 析构时等待所有 strand 空闲。
+ */
+template<typename Key, typename Pool, typename Hash = std::hash<Key>>
+class keyed_executor
+{
+public:
+  ///
+  keyed_executor(Pool& pool, std::size_t strands, std::size_t batch = 64)
+  {
+    assert(strands >= 1u);
+    strands_.reserve(strands);
+    for (std::size_t i = 0; i < strands; ++i) {
+      strands_.push_back(std::make_unique<strand<Pool>>(pool, batch));
+    }
+  }
+
+  ///
+  void post(const Key& key, std::function<void()> fn)
+  {
+    strand_for(key).post(std::move(fn));
+  }
+
+  ///
+  template<typename Fn, typename... Args>
+  auto submit(const Key& key, Fn&& f, Args... args)
+  {
+    return strand_for(key).submit(std::forward<Fn>(f), std::forward<Args>(args)...);
+  }
+
+  /// 等待所有已投递的任务执行完，见 strand::wait_idle()。
+  void wait_idle()
+  {
+    for (auto& s: strands_) {
+      s->wait_idle();
+    }
+  }
+
+  ///
+  strand<Pool>& strand_for(const Key& key)
+  {
+    return *strands_[Hash {}(key) % strands_.size()];
+  }
+
+private:
+  std::vector<std::unique_ptr<strand<Pool>>> strands_;
+};
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include "thread_pool_v0.hpp"
+
+/// 结构化并发：scope 拥有在它之下 spawn 的所有子任务。
+/**
+ * - 析构（或 wait()）之前所有子任务都已结束，子任务可以放心引用 scope 所在栈帧上的数据；
+ * - 第一个失败的子任务让 scope 请求停止，其余子任务经由 stop_token 看到取消；
+ * - 以父 scope 的 token 构造，取消会沿着树向下传播。
+ * 取消是协作式的：还没开始执行的子任务直接跳过，正在执行的需要自己检查 token。
+ * @code
+ * task_scope scope {pool};
+ * for (auto& shard: shards) {
+ *   scope.spawn([&](std::stop_token stop) {
+ *     for (auto& row: shard) {
+ *       if (stop.stop_requested()) return;
+ *       ...
+ *     }
+ *   });
+ * }
+ * scope.wait(); // 重新抛出第一个子任务的异常
+ * @endcode
+ */
+template<typename Pool>
+class task_scope
+{
+public:
+  ///
+  explicit task_scope(Pool& pool, std::stop_token parent = {})
+    : pool_ {pool}
+    , link_ {std::move(parent), forward_stop {&source_}}
+  {
+  }
+
+  /// 嵌套的 scope，父 scope 被取消时一起取消。
+  task_scope(Pool& pool, const task_scope& parent)
+    : task_scope {pool, parent.get_token()}
+  {
+  }
+
+  task_scope(const task_scope&) = delete;
+  task_scope& operator=(const task_scope&) = delete;
+
+  /// 等待所有子任务结束，但不抛出子任务的异常；需要异常的话先调用 wait()。
+  ~task_scope()
+  {
+    join_children();
+  }
+
+  /// fn 可以接受一个 std::stop_token。线程池拒绝时返回 false，并视为子任务失败。
+  /**
+   * 已接纳的子任务被线程池丢弃（比如 CoDel 判定过期）时同样视为失败，wait() 不会因此卡住。
+   */
+  template<typename Fn>
+  bool spawn(Fn&& fn)
+  {
+    {
+      auto lock = std::lock_guard {mutex_};
+      ++pending_;
+    }
+    // std::function 要求可拷贝，而子任务的状态只能析构一次，所以放在 shared_ptr 里。
+    auto state = std::make_shared<child<std::decay_t<Fn>>>(*this, std::forward<Fn>(fn));
+    if (!pool_.post([state]() { state->run(); })) {
+      // 先记下拒绝的原因，state 析构时的 finish() 再让 pending_ 归零。
+      fail(std::make_exception_ptr(std::system_error {
+          std::make_error_code(std::errc::resource_unavailable_try_again), "task_scope::spawn"}));
+      return false;
+    }
+    return true;
+  }
+
+  /// 等待所有子任务结束，有子任务失败时重新抛出第一个异常。
+  /**
+   * 在 worker 线程上调用时，等待期间执行排队中的任务（包括自己的子任务），不会死锁。
+   */
+  void wait()
+  {
+    join_children();
+    auto lock = std::lock_guard {mutex_};
+    if (error_) {
+      std::rethrow_exception(std::exchange(error_, nullptr));
+    }
+  }
+
+  ///
+  void request_stop() noexcept
+  {
+    source_.request_stop();
+  }
+
+  ///
+  std::stop_token get_token() const noexcept
+  {
+    return source_.get_token();
+  }
+
+private:
+  struct forward_stop
+  {
+    std::stop_source* target;
+
+    void operator()() const noexcept
+    {
+      target->request_stop();
+    }
+  };
+
+  /// 子任务的状态，最后一个引用释放时通知 scope。
+  /**
+   * 线程池丢弃没有执行的任务时只是析构它，所以 finish() 放在析构函数里：
+   * 执行过的正常结束，没有执行过的记为失败。
+   */
+  template<typename Fn>
+  class child
+  {
+  public:
+    child(task_scope& scope, Fn fn)
+      : scope_ {scope}
+      , fn_ {std::move(fn)}
+    {
+    }
+
+    child(const child&) = delete;
+    child& operator=(const child&) = delete;
+
+    ~child()
+    {
+      if (fn_) {
+        // fn 先于 finish() 析构，它捕获的资源不会比 scope 活得更久。
+        fn_.reset();
+        scope_.fail(std::make_exception_ptr(std::system_error {
+            std::make_error_code(std::errc::operation_canceled), "task_scope: child dropped by the pool"}));
+      }
+      scope_.finish();
+    }
+
+    void run()
+    {
+      scope_.run_child(std::move(*fn_));
+      fn_.reset();
+    }
+
+  private:
+    task_scope& scope_;
+    std::optional<Fn> fn_;
+  };
+
+  /// fn 按值传入，在 finish() 之前析构，它捕获的资源不会比 scope 活得更久。
+  template<typename Fn>
+  void run_child(Fn fn)
+  {
+    auto token = source_.get_token();
+    if (token.stop_requested()) {
+      return;
+    }
+    try {
+      if constexpr (std::is_invocable_v<Fn&, std::stop_token>) {
+        fn(std::move(token));
+      } else {
+        fn();
+      }
+    } catch (...) {
+      fail(std::current_exception());
+    }
+  }
+
+  void fail(std::exception_ptr e)
+  {
+    {
+      auto lock = std::lock_guard {mutex_};
+      if (!error_) {
+        error_ = std::move(e);
+      }
+    }
+    source_.request_stop();
+  }
+
+  void finish()
+  {
+    // 持锁通知：等待者可能一看到 pending_ 为 0 就析构 scope。
+    auto lock = std::lock_guard {mutex_};
+    if (--pending_ == 0) {
+      done_.notify_all();
+    }
+  }
+
+  void join_children()
+  {
+    auto hooks = worker_hooks::current();
+    auto lock = std::unique_lock {mutex_};
+    while (pending_ > 0) {
+      if (hooks) {
+        lock.unlock();
+        if (!hooks->run_pending()) {
+          // 剩下的子任务都在别的 worker 上运行，让线程池补充一个 worker 再睡眠。
+          blocking_region region;
+          lock.lock();
+          done_.wait(lock, [this]() { return pending_ == 0; });
+          continue;
+        }
+        lock.lock();
+      } else {
+        done_.wait(lock, [this]() { return pending_ == 0; });
+      }
+    }
+  }
+
+private:
+  Pool& pool_;
+  std::stop_source source_;
+  // 必须在 source_ 之后构造：父 token 已经停止时回调在构造函数里就会执行。
+  std::stop_callback<forward_stop> link_;
+  std::mutex mutex_;
+  std::condition_variable done_;
+  std::size_t pending_ {0};
+  std::exception_ptr error_;
+};
@@ -0,0 +1,172 @@
+// transform 的回归测试：窄化的饱和与 NaN、各 SIMD 内核与逐个转换逐位一致，
+// 以及 transform<V>(vt, pool) 在线程池拒绝或丢弃块时仍然给出完整的结果。
+// Release 构建定义了 NDEBUG，所以这里不用 assert。
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "cpp/gotchas/transform.hpp"
+#include "thread_pool_v0.hpp"
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const char* what)
+{
+	if (!ok) {
+		std::fprintf(stderr, "FAILED: %s\n", what);
+		++failures;
+	}
+}
+
+/// 逐字节比较，NaN 和 -0.0 也要一致。
+template<typename V>
+bool same_bits(const std::vector<V>& a, const std::vector<V>& b)
+{
+	return a.size() == b.size() && (a.empty() || std::memcmp(a.data(), b.data(), a.size() * sizeof(V)) == 0);
+}
+
+/// 各种长度的前缀：覆盖 AVX2 主循环、SSE2 段和不到一个向量的标量尾部。
+template<typename V, typename T>
+void check_kernel(const std::vector<T>& values, const char* what)
+{
+	for (std::size_t n = 0; n <= values.size(); n += (n < 40 ? 1 : 37)) {
+		const std::vector<T> in(values.begin(), values.begin() + n);
+		std::vector<V> expected(n);
+		for (std::size_t i = 0; i < n; ++i) {
+			expected[i] = transform_detail::convert_value<V>(in[i]);
+		}
+		if (!same_bits(transform<V>(in), expected)) {
+			std::fprintf(stderr, "  length %zu\n", n);
+			check(false, what);
+			return;
+		}
+	}
+}
+
+/// 边界值在前，随后是随机值，总长为奇数。
+template<typename T>
+std::vector<T> kernel_input(std::vector<T> edges)
+{
+	std::mt19937_64 rng {42};
+	while (edges.size() < 1027) {
+		const std::uint64_t bits = rng();
+		if constexpr (std::is_floating_point_v<T>) {
+			// 指数范围放宽到超出各整数类型，符号随机。
+			const double magnitude = std::ldexp(double(bits >> 11) / double(1ull << 53), int(bits % 80) - 8);
+			edges.push_back(static_cast<T>((bits & 1) ? -magnitude : magnitude));
+		} else {
+			// 一半落在窄类型的范围附近，一半是任意值。
+			const auto shift = (bits & 1) ? 0 : int((bits >> 1) % (8 * sizeof(T)));
+			edges.push_back(static_cast<T>(static_cast<T>(rng()) >> shift));
+		}
+	}
+	return edges;
+}
+
+void check_saturation()
+{
+	const float inf = std::numeric_limits<float>::infinity();
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	auto i32 = transform<std::int32_t>(std::vector<float> {1.9f, -1.9f, 3e9f, -3e9f, inf, -inf, nan, 7.0f, -0.5f, 2147483520.0f, 2147483648.0f});
+	check(i32 == std::vector<std::int32_t> {1, -1, INT32_MAX, INT32_MIN, INT32_MAX, INT32_MIN, 0, 7, 0, 2147483520, INT32_MAX},
+	      "float -> int32 saturates, NaN -> 0");
+
+	auto i16 = transform<std::int16_t>(std::vector<std::int32_t> {40000, -40000, 5, 0, 32767, -32768, 32768, -32769, 1, 2, 3, 4, 5, 6, 7, 8, 9});
+	check(i16 == std::vector<std::int16_t> {32767, -32768, 5, 0, 32767, -32768, 32767, -32768, 1, 2, 3, 4, 5, 6, 7, 8, 9},
+	      "int32 -> int16 saturates");
+
+	auto narrow = transform<std::int32_t>(std::vector<std::int64_t> {INT64_MAX, INT64_MIN, 1ll << 31, -(1ll << 31) - 1, -5, 5});
+	check(narrow == std::vector<std::int32_t> {INT32_MAX, INT32_MIN, INT32_MAX, INT32_MIN, -5, 5}, "int64 -> int32 saturates");
+
+	auto u8 = transform<std::uint8_t>(std::vector<double> {-1.0, 255.9, 256.0, std::nan(""), 1e300, 3.5});
+	check(u8 == std::vector<std::uint8_t> {0, 255, 255, 0, 255, 3}, "double -> uint8 saturates, NaN -> 0");
+}
+
+void check_kernels()
+{
+	const float fmax = std::numeric_limits<float>::max();
+	const float inf = std::numeric_limits<float>::infinity();
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	const double dinf = std::numeric_limits<double>::infinity();
+	const double dnan = std::numeric_limits<double>::quiet_NaN();
+
+	check_kernel<float>(kernel_input<std::int32_t>({INT32_MAX, INT32_MIN, 0, -1, 16777217, -16777217}), "int32 -> float");
+	check_kernel<double>(kernel_input<std::int64_t>({INT64_MAX, INT64_MIN, 0, -1, (1ll << 53) + 1, -(1ll << 53) - 1,
+	                                                 (1ll << 62) + 1, 0x7fffffff, 0x80000000, -0x80000001ll}),
+	                     "int64 -> double");
+	check_kernel<std::int32_t>(kernel_input<float>({nan, -nan, inf, -inf, fmax, -fmax, 2147483648.0f, -2147483648.0f,
+	                                                2147483520.0f, -0.0f, 0.5f, -0.5f, 1e-45f}),
+	                           "float -> int32");
+	check_kernel<float>(kernel_input<double>({dnan, dinf, -dinf, 1e300, -1e300, 1e-300, -0.0, 3.4028235677973366e38,
+	                                          0.1, 16777217.0}),
+	                    "double -> float");
+	check_kernel<std::int16_t>(kernel_input<std::int32_t>({INT32_MAX, INT32_MIN, 32767, 32768, -32768, -32769, 0}),
+	                           "int32 -> int16");
+	check_kernel<std::int32_t>(kernel_input<std::int64_t>({INT64_MAX, INT64_MIN, INT32_MAX, INT32_MIN, 1ll << 31,
+	                                                       -(1ll << 31) - 1, 0, -1}),
+	                           "int64 -> int32");
+	// 布局相同，走 memcpy。
+	check_kernel<long long>(kernel_input<std::int64_t>({INT64_MAX, INT64_MIN, 0}), "int64 -> long long");
+}
+
+std::vector<std::int32_t> make_input(std::size_t n)
+{
+	std::vector<std::int32_t> v(n);
+	for (std::size_t i = 0; i < n; ++i) {
+		v[i] = static_cast<std::int32_t>(i * 2654435761u);
+	}
+	return v;
+}
+
+} // namespace
+
+int main()
+{
+	check_saturation();
+	check_kernels();
+
+	const auto input = make_input(2'000'001);
+	const auto expected = transform<float>(input);
+
+	{
+		thread_pool pool {4};
+		check(transform<float>(input, pool) == expected, "unbounded pool");
+	}
+
+	{
+		// 一个 worker、容量 2、满了就拒绝：大部分块 spawn 失败，scope 随之取消。
+		admission_control admission;
+		admission.capacity = 2;
+		admission.when_full = overflow_policy::reject;
+		thread_pool pool {1, admission};
+		for (int round = 0; round < 8; ++round) {
+			check(transform<float>(input, pool) == expected, "bounded rejecting pool");
+		}
+		check(pool.stats().rejected > 0, "bounded rejecting pool rejected some chunks");
+	}
+
+	{
+		// worker 先被占住，排队的块在 CoDel 眼里都已过期。
+		admission_control admission;
+		admission.codel_target = std::chrono::microseconds(100);
+		admission.codel_interval = std::chrono::microseconds(500);
+		thread_pool pool {1, admission};
+		for (int round = 0; round < 4; ++round) {
+			pool.post([]() { std::this_thread::sleep_for(std::chrono::milliseconds(5)); });
+			check(transform<float>(input, pool) == expected, "CoDel pool");
+		}
+	}
+
+	if (failures == 0) {
+		std::puts("transform: all checks passed");
+	}
+	return failures == 0 ? 0 : 1;
+}
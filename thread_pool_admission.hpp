@@ -0,0 +1,128 @@
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+
+/// 队列已满时 submit() 的行为。
+enum class overflow_policy
+{
+  block,  ///< 阻塞调用者直到有空位
+  reject, ///< 立即拒绝
+};
+
+///
+enum class reject_reason
+{
+  queue_full, ///< 有界队列已满
+  expired,    ///< 被 CoDel 判定排队过久而丢弃
+  stopped,    ///< 线程池已停止
+};
+
+/// 线程池的准入控制配置，默认值等价于无界队列、不丢弃。
+struct admission_control
+{
+  /// 队列容量，0 表示不限制。
+  std::size_t capacity {0};
+  ///
+  overflow_policy when_full {overflow_policy::block};
+  /// CoDel 的目标排队时间，0 表示关闭。
+  std::chrono::nanoseconds codel_target {0};
+  /// CoDel 的观察窗口：排队时间持续高于目标超过一个窗口才开始丢弃。
+  std::chrono::nanoseconds codel_interval {std::chrono::milliseconds(100)};
+  /// 任务被拒绝或过期时调用，不持有线程池的锁。label 为提交时的标签，可能为空。
+  std::function<void(reject_reason, const char* label)> on_rejected;
+  /// post()/defer() 的任务抛出异常时在 worker 上调用，不能再抛出。
+  /// 为空时异常只计入 admission_stats::failed。submit() 的异常照常由 future 传递。
+  std::function<void(std::exception_ptr, const char* label)> on_exception;
+};
+
+///
+struct admission_stats
+{
+  std::uint64_t admitted;
+  std::uint64_t rejected;
+  std::uint64_t expired;
+  std::uint64_t failed; ///< 抛出异常的任务
+};
+
+/// CoDel（RFC 8289）的控制逻辑，以任务出队时的排队时间（sojourn time）为输入。
+/**
+ * 与按队列长度限流不同，CoDel 区分"好的队列"（突发，很快排空）和
+ * "坏的队列"（持续积压）：只有排队时间在整整一个 interval 内都高于 target
+ * 才开始丢弃，之后按 interval/sqrt(count) 逐步加快丢弃节奏，
+ * 直到排队时间回落到 target 以下。调用者需持有队列锁。
+ */
+class codel_controller
+{
+public:
+  using clock = std::chrono::steady_clock;
+
+  ///
+  codel_controller(std::chrono::nanoseconds target, std::chrono::nanoseconds interval)
+    : target_ {target}
+    , interval_ {interval}
+  {
+  }
+
+  ///
+  bool enabled() const noexcept
+  {
+    return target_.count() > 0;
+  }
+
+  /// 刚出队的任务是否应当丢弃。
+  bool should_drop(clock::time_point now, clock::time_point enqueued) noexcept
+  {
+    const bool ok_to_drop = above_target(now, now - enqueued);
+    if (dropping_) {
+      if (!ok_to_drop) {
+        dropping_ = false;
+        return false;
+      }
+      if (now >= drop_next_) {
+        ++count_;
+        drop_next_ = control_law(drop_next_);
+        return true;
+      }
+      return false;
+    }
+    if (ok_to_drop) {
+      dropping_ = true;
+      // 如果刚退出丢弃状态不久，从接近上次的节奏继续，而不是从头开始。
+      count_ = (count_ > 2 && now - drop_next_ < 16 * interval_) ? count_ - 2 : 1;
+      drop_next_ = control_law(now);
+      return true;
+    }
+    return false;
+  }
+
+private:
+  bool above_target(clock::time_point now, clock::duration sojourn) noexcept
+  {
+    if (sojourn < target_) {
+      first_above_ = {};
+      return false;
+    }
+    if (first_above_ == clock::time_point {}) {
+      first_above_ = now + interval_;
+      return false;
+    }
+    return now >= first_above_;
+  }
+
+  clock::time_point control_law(clock::time_point t) const noexcept
+  {
+    return t + std::chrono::duration_cast<clock::duration>(interval_ / std::sqrt(double(count_)));
+  }
+
+  std::chrono::nanoseconds target_;
+  std::chrono::nanoseconds interval_;
+  clock::time_point first_above_ {};
+  clock::time_point drop_next_ {};
+  std::uint32_t count_ {0};
+  bool dropping_ {false};
+};
@@ -0,0 +1,342 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ios>
+#include <iomanip>
+#include <memory>
+#include <ostream>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/// 跟踪用的时钟，x86 上用 rdtsc（几个纳秒），其它平台退回 CLOCK_MONOTONIC。
+struct trace_clock
+{
+  static std::uint64_t now() noexcept
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+  }
+
+  /// 每个 tick 对应的纳秒数，第一次调用时用 steady_clock 校准约 10ms。
+  static double ns_per_tick() noexcept
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    static const double ratio = []() {
+      const auto t0 = std::chrono::steady_clock::now();
+      const auto c0 = now();
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      const auto t1 = std::chrono::steady_clock::now();
+      const auto c1 = now();
+      return double(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count()) / double(c1 - c0);
+    }();
+    return ratio;
+#else
+    return 1.0;
+#endif
+  }
+};
+
+/// HDR 风格的对数-线性直方图：每个 2 的幂区间再均分为 16 个子桶，相对误差 < 6.25%。
+/**
+ * 只有一个写者（所属的 worker），计数用 relaxed 原子变量，
+ * 汇总线程可以随时读取而不需要加锁。
+ */
+class latency_histogram
+{
+public:
+  static constexpr unsigned sub_bits = 4;
+  static constexpr unsigned sub_count = 1u << sub_bits;
+  static constexpr unsigned bucket_count = (64 - sub_bits + 1) * sub_count;
+
+  ///
+  void record(std::uint64_t value) noexcept
+  {
+    auto& c = counts_[index_of(value)];
+    c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  ///
+  void merge_into(std::vector<std::uint64_t>& out) const
+  {
+    out.resize(bucket_count);
+    for (unsigned i = 0; i < bucket_count; ++i) {
+      out[i] += counts_[i].load(std::memory_order_relaxed);
+    }
+  }
+
+  /// 给定汇总后的计数，返回分位数对应的桶上界。
+  static std::uint64_t percentile(const std::vector<std::uint64_t>& counts, double q)
+  {
+    std::uint64_t total = 0;
+    for (auto c: counts) {
+      total += c;
+    }
+    if (total == 0) {
+      return 0;
+    }
+    const auto rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(q * double(total) + 0.5));
+    std::uint64_t seen = 0;
+    for (unsigned i = 0; i < counts.size(); ++i) {
+      seen += counts[i];
+      if (seen >= rank) {
+        return upper_bound_of(i);
+      }
+    }
+    return upper_bound_of(bucket_count - 1);
+  }
+
+private:
+  static unsigned index_of(std::uint64_t v) noexcept
+  {
+    if (v < sub_count) {
+      return static_cast<unsigned>(v);
+    }
+    const unsigned exp = std::bit_width(v) - sub_bits; // >= 1
+    return exp * sub_count + static_cast<unsigned>((v >> (exp - 1)) & (sub_count - 1));
+  }
+
+  static std::uint64_t upper_bound_of(unsigned index) noexcept
+  {
+    const unsigned exp = index / sub_count;
+    const std::uint64_t sub = index % sub_count;
+    if (exp == 0) {
+      return sub;
+    }
+    return ((sub_count + sub + 1) << (exp - 1)) - 1;
+  }
+
+  std::array<std::atomic<std::uint64_t>, bucket_count> counts_ {};
+};
+
+/// 每个 worker 一个单写者环形缓冲，写满后覆盖最旧的记录。
+/**
+ * 每个槽位是一个 seqlock：写者先把序号置为奇数，写完字段后置为偶数；
+ * 读者前后两次读到相同的偶数序号才算读到完整记录。写路径上没有 RMW 原子操作。
+ */
+class trace_ring
+{
+public:
+  struct record
+  {
+    const char* label;
+    std::uint64_t enqueued;
+    std::uint64_t started;
+    std::uint64_t finished;
+  };
+
+  explicit trace_ring(std::size_t capacity)
+    : slots_(std::bit_ceil(capacity))
+    , mask_(slots_.size() - 1)
+  {
+  }
+
+  ///
+  void push(const record& r) noexcept
+  {
+    const auto n = head_.load(std::memory_order_relaxed);
+    auto& s = slots_[n & mask_];
+    const auto seq = s.seq.load(std::memory_order_relaxed);
+    s.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    s.label.store(r.label, std::memory_order_relaxed);
+    s.enqueued.store(r.enqueued, std::memory_order_relaxed);
+    s.started.store(r.started, std::memory_order_relaxed);
+    s.finished.store(r.finished, std::memory_order_relaxed);
+    s.seq.store(seq + 2, std::memory_order_release);
+    head_.store(n + 1, std::memory_order_release);
+  }
+
+  /// 拷贝出当前仍在缓冲里的记录（按时间顺序）。
+  template<typename Fn>
+  void for_each(Fn&& fn) const
+  {
+    const auto head = head_.load(std::memory_order_acquire);
+    const auto begin = head > slots_.size() ? head - slots_.size() : 0;
+    for (auto n = begin; n < head; ++n) {
+      const auto& s = slots_[n & mask_];
+      const auto seq0 = s.seq.load(std::memory_order_acquire);
+      if (seq0 & 1) {
+        continue;
+      }
+      record r {
+        s.label.load(std::memory_order_relaxed),
+        s.enqueued.load(std::memory_order_relaxed),
+        s.started.load(std::memory_order_relaxed),
+        s.finished.load(std::memory_order_relaxed),
+      };
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (s.seq.load(std::memory_order_relaxed) == seq0) {
+        fn(r);
+      }
+    }
+  }
+
+private:
+  struct slot
+  {
+    std::atomic<std::uint64_t> seq {0};
+    std::atomic<const char*> label {nullptr};
+    std::atomic<std::uint64_t> enqueued {0};
+    std::atomic<std::uint64_t> started {0};
+    std::atomic<std::uint64_t> finished {0};
+  };
+
+  std::vector<slot> slots_;
+  std::size_t mask_;
+  std::atomic<std::uint64_t> head_ {0};
+};
+
+/// 不做任何跟踪，thread_pool 的默认策略。
+struct no_trace
+{
+  static constexpr bool enabled = false;
+  struct stamp {};
+};
+
+/// 记录每个任务的入队/开始/结束时间，统计排队时间和执行时间。
+class task_tracer
+{
+public:
+  static constexpr bool enabled = true;
+
+  /// 随任务一起进入队列的信息。
+  struct stamp
+  {
+    const char* label {nullptr};
+    std::uint64_t enqueued {0};
+  };
+
+  /// 排队时间、执行时间和入队时队列深度的分位数，时间单位为纳秒。
+  struct summary
+  {
+    std::uint64_t tasks;
+    std::uint64_t queue_wait_p50, queue_wait_p99, queue_wait_p999;
+    std::uint64_t run_time_p50, run_time_p99, run_time_p999;
+    std::uint64_t depth_p50, depth_p99;
+  };
+
+  ///
+  void init(std::size_t workers, std::size_t ring_capacity = 1u << 14)
+  {
+    // 在构造线程池时完成时钟校准，而不是在第一个任务的执行路径上。
+    trace_clock::ns_per_tick();
+    workers_.clear();
+    for (std::size_t i = 0; i < workers; ++i) {
+      workers_.push_back(std::make_unique<per_worker>(ring_capacity));
+    }
+  }
+
+  /// 入队时调用，调用方持有队列锁。
+  stamp on_enqueue(const char* label, std::size_t depth) noexcept
+  {
+    depth_.record(depth);
+    return {label, trace_clock::now()};
+  }
+
+  /// worker 执行完任务后调用。
+  void on_finish(std::size_t worker, const stamp& s, std::uint64_t started, std::uint64_t finished) noexcept
+  {
+    auto& w = *workers_[worker];
+    const double k = trace_clock::ns_per_tick();
+    w.queue_wait.record(static_cast<std::uint64_t>(double(started - s.enqueued) * k));
+    w.run_time.record(static_cast<std::uint64_t>(double(finished - started) * k));
+    w.ring.push({s.label, s.enqueued, started, finished});
+  }
+
+  ///
+  summary summarize() const
+  {
+    std::vector<std::uint64_t> wait, run, depth;
+    for (auto& w: workers_) {
+      w->queue_wait.merge_into(wait);
+      w->run_time.merge_into(run);
+    }
+    depth_.merge_into(depth);
+    std::uint64_t tasks = 0;
+    for (auto c: run) {
+      tasks += c;
+    }
+    return {
+      tasks,
+      latency_histogram::percentile(wait, 0.50),
+      latency_histogram::percentile(wait, 0.99),
+      latency_histogram::percentile(wait, 0.999),
+      latency_histogram::percentile(run, 0.50),
+      latency_histogram::percentile(run, 0.99),
+      latency_histogram::percentile(run, 0.999),
+      latency_histogram::percentile(depth, 0.50),
+      latency_histogram::percentile(depth, 0.99),
+    };
+  }
+
+  /// 导出为 Chrome trace-event JSON，用 chrome://tracing 或 Perfetto 打开。
+  void write_chrome_trace(std::ostream& os) const
+  {
+    const double us_per_tick = trace_clock::ns_per_tick() / 1000.0;
+    bool first = true;
+    const auto flags = os.flags();
+    const auto precision = os.precision();
+    os << std::fixed << std::setprecision(3);
+    os << "{\"traceEvents\":[";
+    for (std::size_t i = 0; i < workers_.size(); ++i) {
+      workers_[i]->ring.for_each([&](const trace_ring::record& r) {
+        os << (first ? "\n" : ",\n");
+        first = false;
+        os << "{\"name\":\"";
+        write_escaped(os, r.label ? r.label : "task");
+        os << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << i
+           << ",\"ts\":" << double(r.started) * us_per_tick
+           << ",\"dur\":" << double(r.finished - r.started) * us_per_tick
+           << ",\"args\":{\"queue_us\":" << double(r.started - r.enqueued) * us_per_tick << "}}";
+      });
+    }
+    os << "\n],\"displayTimeUnit\":\"ns\"}\n";
+    os.flags(flags);
+    os.precision(precision);
+  }
+
+private:
+  static void write_escaped(std::ostream& os, std::string_view s)
+  {
+    for (char c: s) {
+      if (c == '"' || c == '\\') {
+        os << '\\' << c;
+      } else if (static_cast<unsigned char>(c) < 0x20) {
+        os << ' ';
+      } else {
+        os << c;
+      }
+    }
+  }
+
+  // 按缓存行对齐，避免不同 worker 的计数互相伪共享。
+  struct alignas(64) per_worker
+  {
+    explicit per_worker(std::size_t ring_capacity)
+      : ring(ring_capacity)
+    {
+    }
+
+    latency_histogram queue_wait;
+    latency_histogram run_time;
+    trace_ring ring;
+  };
+
+  std::vector<std::unique_ptr<per_worker>> workers_;
+  latency_histogram depth_;
+};
@@ -1,164 +1,247 @@
 #include <atomic>
-#include <cstddef>
-#include <cassert>
-#include <condition_variable>
-#include <functional>
+#include <chrono>
+#include <fstream>
 #include <future>
 #include <iostream>
-#include <stop_token>
-#include <thread>
+#include <stdexcept>
 #include <vector>
-#include <queue>
 
-class thread_pool
+#include "strand.hpp"
+#include "task_scope.hpp"
+#include "thread_pool_v0.hpp"
+#include "worker_local.hpp"
+
+/// 每个任务的平均开销（提交 + 调度 + 执行一个空任务），用来对比开启跟踪前后。
+template<typename Pool>
+double ns_per_task(Pool& pool, int n)
 {
-public:
-  ///
-  explicit thread_pool(std::size_t capacity)
-  {
-    assert(capacity >= 1u);
-    threads_.reserve(capacity);
-    for (int i = 0; i < capacity; ++i) {
-      threads_.emplace_back(std::bind_front(&thread_pool::scheduled_run, this));
-      // alternative:
-      //   threads_.emplace_back(std::bind(&thread_pool::scheduled_run, this, std::placeholders::_1))
-      // alternative:
-      //   threads_.emplace_back([this](std::stop_token s) { scheduled_run(s); });
-    }
+  std::vector<std::future<void>> futures;
+  futures.reserve(n);
+  const auto start = std::chrono::steady_clock::now();
+  for (int k = 0; k < n; ++k) {
+    futures.push_back(pool.submit_labeled("noop", []() {}));
   }
-
-  ///
-  ~thread_pool()
-  {
-    stop();
-    join();
+  for (auto& f: futures) {
+    f.wait();
   }
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  return double(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / n;
+}
+
+int main(int argc, char *argv[])
+{
+  thread_pool pool {10};
+  std::atomic_int i {0};
+  int j = 0;
+  pool.submit([&i]() { for (int j = 0; j < 10000; ++j) ++i; });
+  pool.submit([&i]() { for (int j = 0; j < 1000; ++j) ++i; });
+  pool.submit([&i]() { for (int j = 0; j < 1000; ++j) ++i; });
+  pool.submit([&i]() { for (int j = 0; j < 1000; ++j) ++i; });
+  pool.submit([&i]() { for (int j = 0; j < 1000; ++j) ++i; });
+  pool.submit([&i]() { for (int j = 0; j < 1000; ++j) ++i; });
+  pool.submit([&i]() { for (int j = 0; j < 1000; ++j) ++i; });
+  pool.submit([&i]() { for (int j = 0; j < 1000; ++j) ++i; });
+  pool.submit([&i]() { for (int j = 0; j < 1000; ++j) ++i; });
+  pool.submit([&i]() { for (int j = 0; j < 1000; ++j) ++i; });
+  pool.wait();
+  pool.stop();
+  pool.join();
+  std::cout << i << std::endl;
 
-  ///
-  void stop()
   {
-    for (auto&& t: threads_) {
-      t.request_stop();
-    }
-    condvar_.notify_all();
+    thread_pool plain {4};
+    traced_thread_pool traced {4};
+    std::cout << "untraced: " << ns_per_task(plain, 200000) << " ns/task" << std::endl;
+    std::cout << "traced:   " << ns_per_task(traced, 200000) << " ns/task" << std::endl;
+
+    auto s = traced.tracer().summarize();
+    std::cout << "tasks: " << s.tasks
+              << " queue wait p50/p99/p99.9: " << s.queue_wait_p50 << "/" << s.queue_wait_p99 << "/" << s.queue_wait_p999 << " ns"
+              << " run p50/p99/p99.9: " << s.run_time_p50 << "/" << s.run_time_p99 << "/" << s.run_time_p999 << " ns"
+              << " depth p50/p99: " << s.depth_p50 << "/" << s.depth_p99 << std::endl;
+
+    std::ofstream out {"thread_pool_trace.json"};
+    traced.tracer().write_chrome_trace(out);
   }
 
-  ///
-  void join()
   {
-    for (auto&& t: threads_) {
-      if (t.joinable()) {
-        t.join();
+    // 同一个账户的任务按顺序执行，账户状态不需要加锁。
+    thread_pool workers {4};
+    keyed_executor<int, thread_pool> accounts {workers, 64};
+    constexpr int kAccounts = 8;
+    constexpr int kOps = 10000;
+    std::vector<int> last_seq(kAccounts, -1);
+    std::atomic_int out_of_order {0};
+    std::vector<std::future<void>> done;
+    for (int op = 0; op < kOps; ++op) {
+      for (int a = 0; a < kAccounts; ++a) {
+        accounts.post(a, [&, a, op]() {
+          if (last_seq[a] + 1 != op) {
+            ++out_of_order;
+          }
+          last_seq[a] = op;
+        });
       }
     }
+    for (int a = 0; a < kAccounts; ++a) {
+      done.push_back(accounts.submit(a, []() {}));
+    }
+    for (auto& f: done) {
+      f.wait();
+    }
+    // future 就绪时 drain 可能还在收尾，等线程池排空之后 accounts 才能析构。
+    workers.wait();
+    std::cout << "strand out-of-order: " << out_of_order << " last: " << last_seq[0] << std::endl;
   }
 
-  /// Wait all pending jobs to be completed.
-  /**
-   * 算是基本操作，等待队列中所有的工作执行完毕
-   * @code
-   * while (!tasks_.empty()) {} // 应该避免 busy-loop
-   * join();
-   * @endcode
-   */
-  void wait()
-  {
-  }
-  
-  /// Stop thread pool manager
-  /**
-   * 停止接收新工作
-   */
-  void terminate()
   {
+    // post() 和 strand 的任务抛出的异常交给 on_exception，worker 和 strand 照常运行。
+    std::atomic_int reported {0};
+    admission_control handlers;
+    handlers.on_exception = [&reported](std::exception_ptr, const char*) { ++reported; };
+    thread_pool workers {2, handlers};
+    strand<thread_pool> serial {workers};
+    workers.post([]() { throw std::runtime_error {"post"}; });
+    serial.post([]() { throw std::runtime_error {"strand"}; });
+    auto after = serial.submit([]() { return 42; });
+    std::cout << "after throwing task: " << after.get();
+    serial.wait_idle();
+    workers.wait();
+    std::cout << " reported: " << reported << " failed: " << workers.stats().failed << std::endl;
   }
 
-  /// Cancel all pending jobs
-  /** */
-  void cancel()
   {
+    // 过载：有界队列直接拒绝，CoDel 丢弃排队过久的任务。
+    std::atomic_int rejected_callbacks {0};
+    admission_control admission;
+    admission.capacity = 64;
+    admission.when_full = overflow_policy::reject;
+    admission.codel_target = std::chrono::milliseconds(5);
+    admission.codel_interval = std::chrono::milliseconds(20);
+    admission.on_rejected = [&rejected_callbacks](reject_reason, const char*) { ++rejected_callbacks; };
+    thread_pool overloaded {2, admission};
+    std::vector<std::future<void>> futures;
+    for (int k = 0; k < 2000; ++k) {
+      futures.push_back(overloaded.submit([]() { std::this_thread::sleep_for(std::chrono::microseconds(500)); }));
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    int broken = 0;
+    for (auto& f: futures) {
+      try {
+        f.get();
+      } catch (const std::future_error&) {
+        ++broken;
+      }
+    }
+    auto st = overloaded.stats();
+    std::cout << "admitted: " << st.admitted << " rejected: " << st.rejected << " expired: " << st.expired
+              << " callbacks: " << rejected_callbacks << " broken futures: " << broken << std::endl;
   }
-
-  ///
-  template<typename Fn, typename... Args>
-  auto submit(Fn&& f, Args... args)
   {
-    using return_type = std::result_of_t<Fn(Args...)>;
-    // 这里使用 std::bind 是因为没法直接使用闭包捕获来完美转发；
-    // 另一个方法是通过 reference wrapper 来实现捕获的完美转发。
-    // std::function 要求 Callable 对象是 CopyConstructible 的，
-    // 但 std::packaged_task 并不满足 CopyConstructible 的要求，
-    // 故通过 std::shared_ptr 来满足此的限制。
-    auto ptask = std::make_shared<std::packaged_task<return_type()>>(
-        std::bind(std::forward<Fn>(f), std::forward<Args>(args)...));
-    auto future = ptask->get_future();
-    auto lock = std::lock_guard {mutex_};
-    tasks_.emplace([ptask]() { (*ptask)(); });
-    // 先通知，后释放锁。目的是保证公平性和避免优先级倒置，因为
-    // 互斥锁一般有较完善的阻塞线程调度算法，会按照线程优先级调
-    // 度，相同优先级按照 FIFO 调度。
-    // 理想的调度是 LIFO
-    condvar_.notify_one();
-    // 返回的 future 不能直接 get()，应当先 wait_for(timeout)。
-    // 使用超时机制是因为工作是投递到队列中，该工作可能不会立刻执行。
-    // 若在执行之前，线程池管理器终止所有线程，造成队列中的工作就不会
-    // 执行返回结果，那么 get() 的后果就是无限等待。
-    return future;
-  }
+    // 任务阻塞时补充 worker：2 个 worker 上 16 个各阻塞 50ms 的任务。
+    thread_pool blocking {2};
+    auto run = [&blocking](bool mark) {
+      std::vector<std::future<void>> futures;
+      const auto start = std::chrono::steady_clock::now();
+      for (int k = 0; k < 16; ++k) {
+        futures.push_back(blocking.submit([mark]() {
+          if (mark) {
+            blocking_region region;
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+          } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+          }
+        }));
+      }
+      for (auto& f: futures) {
+        f.wait();
+      }
+      return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    };
+    std::cout << "blocking, unmarked: " << run(false) << " ms" << std::endl;
+    std::cout << "blocking, blocking_region: " << run(true) << " ms" << std::endl;
 
-private:
-  ///
-  void scheduled_run(std::stop_token stop)
+    // 单个 worker 上的嵌套等待：直接 get() 会死锁，help_while_waiting 就地执行子任务。
+    thread_pool single {1};
+    auto outer = single.submit([&single]() {
+      auto inner = single.submit([]() { return 42; });
+      return help_while_waiting(inner) + 1;
+    });
+    std::cout << "nested wait: " << outer.get() << std::endl;
+  }
   {
-    // 有看到线程池实现把 stop_token 当作一个工作投递给线程。
-    // 这样做有问题因为这不是有效的广播行为，投递n次无法保证
-    // n个不同的线程都收到工作。
-    while (!stop.stop_requested()) {
-      auto lock = std::unique_lock {mutex_};
-      condvar_.wait(lock, 
-        [this, &stop]() { return !tasks_.empty() || stop.stop_requested(); });
-      if (stop.stop_requested()) {
-        break;
+    // 结构化并发：一个子任务失败，兄弟任务和嵌套 scope 里的任务都被取消，
+    // 原本各要运行 1s 的任务在失败后很快结束。
+    thread_pool workers {4};
+    std::atomic_int cancelled {0};
+    const auto start = std::chrono::steady_clock::now();
+    try {
+      task_scope scope {workers};
+      auto busy = [&cancelled](std::stop_token stop) {
+        for (int k = 0; k < 1000; ++k) {
+          if (stop.stop_requested()) {
+            ++cancelled;
+            return;
+          }
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+      };
+      for (int k = 0; k < 2; ++k) {
+        scope.spawn(busy);
       }
-
-      auto t = tasks_.front();
-      tasks_.pop();
-      lock.unlock();
-      t();
+      scope.spawn([&]() {
+        // 在 worker 上等待嵌套 scope，期间这个 worker 会帮忙执行排队的任务。
+        task_scope nested {workers, scope};
+        for (int k = 0; k < 4; ++k) {
+          nested.spawn(busy);
+        }
+        nested.wait();
+      });
+      scope.spawn([]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        throw std::runtime_error("shard 3 failed");
+      });
+      scope.wait();
+    } catch (const std::exception& e) {
+      const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+      std::cout << "scope failed: " << e.what() << " after " << ms << " ms, children stopped mid-run: " << cancelled << " (the rest never started)" << std::endl;
     }
   }
-
-private:
-  // 还有另一种做法是封装线程，然后维护两个队列，一个是idle线程
-  // 队列，另一个是busy线程队列。把队列中的工作直接投递到idle线程。
-  // 需要benchmark一番，但内存开销肯定比较大。
-  std::vector<std::jthread> threads_;
-  std::queue<std::function<void()>> tasks_;
-  // 这里有一个难点: 要如何解耦队列锁和条件变量?
-  // 要基于什么一般抽象?
-  std::mutex mutex_;
-  std::condition_variable condvar_;
-};
-
-int main(int argc, char *argv[])
-{
-  thread_pool pool {10};
-  std::atomic_int i {0};
-  int j = 0;
-  pool.submit([&i]() { for (int j = 0; j < 10000; ++j) ++i; });
-  pool.submit([&i]() { for (int j = 0; j < 1000; ++j) ++i; });
-  pool.submit([&i]() { for (int j = 0; j < 1000; ++j) ++i; });
-  pool.submit([&i]() { for (int j = 0; j < 1000; ++j) ++i; });
-  pool.submit([&i]() { for (int j = 0; j < 1000; ++j) ++i; });
-  pool.submit([&i]() { for (int j = 0; j < 1000; ++j) ++i; });
-  pool.submit([&i]() { for (int j = 0; j < 1000; ++j) ++i; });
-  pool.submit([&i]() { for (int j = 0; j < 1000; ++j) ++i; });
-  pool.submit([&i]() { for (int j = 0; j < 1000; ++j) ++i; });
-  pool.submit([&i]() { for (int j = 0; j < 1000; ++j) ++i; });
-  sleep(7); // Workaround for wait()
-  // pool.wait();
-  pool.stop();
-  pool.join();
-  std::cout << i << std::endl;
+  {
+    // 每个 worker 一份计数，汇总时再相加；对比所有 worker 争用同一个原子变量。
+    thread_pool workers {4};
+    worker_local<std::uint64_t> local_hits {workers};
+    alignas(64) std::atomic<std::uint64_t> shared_hits {0};
+    constexpr int kTasks = 64;
+    constexpr int kIncrements = 1000000;
+    auto run = [&workers](auto&& body) {
+      std::vector<std::future<void>> futures;
+      const auto start = std::chrono::steady_clock::now();
+      for (int k = 0; k < kTasks; ++k) {
+        futures.push_back(workers.submit(body));
+      }
+      for (auto& f: futures) {
+        f.wait();
+      }
+      return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    };
+    const auto shared_ms = run([&shared_hits]() {
+      for (int n = 0; n < kIncrements; ++n) {
+        shared_hits.fetch_add(1, std::memory_order_relaxed);
+      }
+    });
+    const auto local_ms = run([&local_hits]() {
+      auto& hits = local_hits.local();
+      for (int n = 0; n < kIncrements; ++n) {
+        // 防止编译器把循环合并成一次加法，和上面的原子操作比较才公平。
+        asm volatile("" : : : "memory");
+        ++hits;
+      }
+    });
+    std::uint64_t total = 0;
+    local_hits.for_each([&total](std::uint64_t n) { total += n; });
+    std::cout << "shared atomic: " << shared_hits << " in " << shared_ms << " ms, worker_local: "
+              << total << " in " << local_ms << " ms" << std::endl;
+  }
   return 0;
 }
@@ -0,0 +1,603 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cassert>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <list>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include <vector>
+#include <queue>
+
+#include "thread_pool_admission.hpp"
+#include "thread_pool_trace.hpp"
+
+/// worker 线程所属线程池的回调入口，供 blocking_region 和 help_while_waiting 使用。
+class worker_hooks
+{
+public:
+  ///
+  virtual void enter_blocking() = 0;
+  ///
+  virtual void leave_blocking() = 0;
+  /// 在当前线程上执行一个排队中的任务，队列为空时返回 false。
+  virtual bool run_pending() = 0;
+
+  /// 当前线程所属的线程池，不是 worker 线程时为空。
+  static worker_hooks*& current() noexcept
+  {
+    thread_local worker_hooks* hooks = nullptr;
+    return hooks;
+  }
+
+  /// 当前 worker 在线程池内的编号，小于 max_workers()；只在 current() 非空时有意义。
+  static std::size_t& worker_index() noexcept
+  {
+    thread_local std::size_t index = 0;
+    return index;
+  }
+
+protected:
+  ~worker_hooks() = default;
+};
+
+/// 任务即将阻塞（I/O、等待锁或 future）时进入，线程池会临时补充一个 worker。
+/**
+ * 不在 worker 线程上时什么都不做；嵌套时只有最外层生效。
+ * @code
+ * pool.submit([]() {
+ *   blocking_region region;
+ *   read(fd, buf, n);
+ * });
+ * @endcode
+ */
+class blocking_region
+{
+public:
+  blocking_region()
+    : hooks_ {depth()++ == 0 ? worker_hooks::current() : nullptr}
+  {
+    if (hooks_) {
+      hooks_->enter_blocking();
+    }
+  }
+
+  blocking_region(const blocking_region&) = delete;
+  blocking_region& operator=(const blocking_region&) = delete;
+
+  ~blocking_region()
+  {
+    --depth();
+    if (hooks_) {
+      hooks_->leave_blocking();
+    }
+  }
+
+private:
+  static int& depth() noexcept
+  {
+    thread_local int d = 0;
+    return d;
+  }
+
+  worker_hooks* hooks_;
+};
+
+/// 等待 future，期间在当前 worker 上执行排队中的任务，而不是占着 worker 睡眠。
+/**
+ * 等待的任务本身还在队列里时，它会直接在这里被执行，嵌套等待不会死锁。
+ * 队列为空后才真正阻塞，并进入 blocking_region 让线程池补充 worker。
+ * 注意：帮忙执行的任务如果耗时很长，本函数的返回也会相应推迟。
+ */
+template<typename T>
+T help_while_waiting(std::future<T>& future)
+{
+  if (auto hooks = worker_hooks::current()) {
+    while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+      if (!hooks->run_pending()) {
+        blocking_region region;
+        future.wait();
+      }
+    }
+  }
+  return future.get();
+}
+
+/// Tracer 为 task_tracer 时记录每个任务的排队/执行时间；默认的 no_trace 不产生任何开销。
+template<typename Tracer = no_trace>
+class basic_thread_pool
+  : private worker_hooks
+{
+public:
+  /// 任务进入 blocking_region 时最多补充的 worker 数，按 capacity 的倍数计。
+  static constexpr std::size_t compensation_factor = 4;
+
+  /// admission 控制队列容量和过载时的丢弃策略，默认不限制。
+  explicit basic_thread_pool(std::size_t capacity, admission_control admission = {})
+    : capacity_ {capacity}
+    , live_ {capacity}
+    , admission_ {std::move(admission)}
+    , codel_ {admission_.codel_target, admission_.codel_interval}
+  {
+    assert(capacity >= 1u);
+    const auto max_compensation = compensation_factor * capacity;
+    if constexpr (Tracer::enabled) {
+      tracer_.init(capacity + max_compensation);
+    }
+    // 补充 worker 的编号（跟踪槽位、worker_local 下标），保证同一时刻每个编号只属于一个线程。
+    for (std::size_t i = 0; i < max_compensation; ++i) {
+      free_slots_.push_back(capacity + max_compensation - 1 - i);
+    }
+    threads_.reserve(capacity);
+    for (std::size_t i = 0; i < capacity; ++i) {
+      threads_.emplace_back(std::bind_front(&basic_thread_pool::scheduled_run, this), i, false);
+      // alternative:
+      //   threads_.emplace_back(std::bind(&thread_pool::scheduled_run, this, std::placeholders::_1))
+      // alternative:
+      //   threads_.emplace_back([this](std::stop_token s) { scheduled_run(s); });
+    }
+  }
+
+  ///
+  ~basic_thread_pool()
+  {
+    stop();
+    join();
+  }
+
+  ///
+  void stop()
+  {
+    {
+      auto lock = std::lock_guard {mutex_};
+      stopped_ = true;
+      for (auto&& c: compensation_) {
+        c.thread.request_stop();
+      }
+    }
+    for (auto&& t: threads_) {
+      t.request_stop();
+    }
+    condvar_.notify_all();
+    not_full_.notify_all();
+    drained_.notify_all();
+  }
+
+  ///
+  void join()
+  {
+    for (auto&& t: threads_) {
+      if (t.joinable()) {
+        t.join();
+      }
+    }
+    // 补充 worker 退出时需要加锁，所以先把列表取出来再 join。
+    std::list<compensation_worker> compensation;
+    {
+      auto lock = std::lock_guard {mutex_};
+      compensation.splice(compensation.end(), compensation_);
+    }
+    for (auto&& c: compensation) {
+      if (c.thread.joinable()) {
+        c.thread.join();
+      }
+    }
+  }
+
+  /// Wait all pending jobs to be completed.
+  /**
+   * 算是基本操作，等待队列中所有的工作执行完毕
+   * @code
+   * while (!tasks_.empty()) {} // 应该避免 busy-loop
+   * join();
+   * @endcode
+   * 只在未完成数归零时通知，任务路径上只多一次原子减法。
+   * stop() 之后不再等待（队列里剩下的工作不会再执行）。
+   * 不能在本线程池的任务里调用，那样它会等待自己。
+   */
+  void wait()
+  {
+    assert(worker_hooks::current() != static_cast<worker_hooks*>(this));
+    auto lock = std::unique_lock {mutex_};
+    drained_.wait(lock, [this]() { return outstanding_.load(std::memory_order_acquire) == 0 || stopped_; });
+  }
+  
+  /// Stop thread pool manager
+  /**
+   * 停止接收新工作
+   */
+  void terminate()
+  {
+  }
+
+  /// Cancel all pending jobs
+  /** */
+  void cancel()
+  {
+  }
+
+  /// 队列已满时按 admission_control::when_full 阻塞或拒绝。
+  /**
+   * 被拒绝或过期的任务不会执行，其 future 的 get() 抛出
+   * std::future_error（broken_promise）。
+   */
+  template<typename Fn, typename... Args>
+  auto submit(Fn&& f, Args... args)
+  {
+    return submit_labeled(nullptr, std::forward<Fn>(f), std::forward<Args>(args)...);
+  }
+
+  /// 带标签提交，标签出现在跟踪导出中，必须是静态存储期的字符串。
+  template<typename Fn, typename... Args>
+  auto submit_labeled(const char* label, Fn&& f, Args... args)
+  {
+    using return_type = std::result_of_t<Fn(Args...)>;
+    // 这里使用 std::bind 是因为没法直接使用闭包捕获来完美转发；
+    // 另一个方法是通过 reference wrapper 来实现捕获的完美转发。
+    // std::function 要求 Callable 对象是 CopyConstructible 的，
+    // 但 std::packaged_task 并不满足 CopyConstructible 的要求，
+    // 故通过 std::shared_ptr 来满足此的限制。
+    auto ptask = std::make_shared<std::packaged_task<return_type()>>(
+        std::bind(std::forward<Fn>(f), std::forward<Args>(args)...));
+    auto future = ptask->get_future();
+    enqueue(label, [ptask]() { (*ptask)(); }, enqueue_mode::blocking);
+    // 返回的 future 不能直接 get()，应当先 wait_for(timeout)。
+    // 使用超时机制是因为工作是投递到队列中，该工作可能不会立刻执行。
+    // 若在执行之前，线程池管理器终止所有线程，造成队列中的工作就不会
+    // 执行返回结果，那么 get() 的后果就是无限等待。
+    return future;
+  }
+
+  /// 从不阻塞：队列已满时返回空。
+  template<typename Fn, typename... Args>
+  auto try_submit(Fn&& f, Args... args)
+    -> std::optional<std::future<std::invoke_result_t<Fn, Args...>>>
+  {
+    using return_type = std::invoke_result_t<Fn, Args...>;
+    auto ptask = std::make_shared<std::packaged_task<return_type()>>(
+        std::bind(std::forward<Fn>(f), std::forward<Args>(args)...));
+    auto future = ptask->get_future();
+    if (!enqueue(nullptr, [ptask]() { (*ptask)(); }, enqueue_mode::non_blocking)) {
+      return std::nullopt;
+    }
+    return future;
+  }
+
+  /// 不需要结果的投递，省掉 packaged_task/future 的分配和同步。返回是否被接纳。
+  /**
+   * fn 抛出的异常交给 admission_control::on_exception，不会终止 worker。
+   */
+  bool post(std::function<void()> fn, const char* label = nullptr)
+  {
+    return enqueue(label, std::move(fn), enqueue_mode::blocking);
+  }
+
+  /// 已被接纳的工作的后续（比如 strand 的下一批），不受容量限制，也不会被 CoDel 丢弃。
+  /**
+   * 否则续作被拒绝会让已经接纳的工作永远无法完成，
+   * 在有界队列上阻塞 worker 还可能让整个线程池死锁。
+   */
+  void defer(std::function<void()> fn, const char* label = nullptr)
+  {
+    enqueue(label, std::move(fn), enqueue_mode::exempt);
+  }
+
+  /// worker 编号的上界，包括补充 worker。
+  std::size_t max_workers() const noexcept
+  {
+    return capacity_ * (1 + compensation_factor);
+  }
+
+  ///
+  admission_stats stats() const
+  {
+    return {
+      admitted_.load(std::memory_order_relaxed),
+      rejected_.load(std::memory_order_relaxed),
+      expired_.load(std::memory_order_relaxed),
+      failed_.load(std::memory_order_relaxed),
+    };
+  }
+
+  /// 只有开启跟踪时可用。
+  const Tracer& tracer() const requires Tracer::enabled
+  {
+    return tracer_;
+  }
+
+private:
+  struct job
+  {
+    std::function<void()> fn;
+    const char* label;
+    bool exempt;
+    codel_controller::clock::time_point enqueued;
+    [[no_unique_address]] typename Tracer::stamp stamp;
+  };
+
+  /// blocking_region 期间临时补充的 worker。
+  struct compensation_worker
+  {
+    std::jthread thread;
+    bool done {false};
+  };
+
+  enum class enqueue_mode
+  {
+    blocking,     ///< 队列满时按 when_full 处理
+    non_blocking, ///< 队列满时直接拒绝
+    exempt,       ///< 不受准入控制
+  };
+
+  ///
+  bool enqueue(const char* label, std::function<void()> fn, enqueue_mode mode)
+  {
+    auto lock = std::unique_lock {mutex_};
+    if (mode != enqueue_mode::exempt) {
+      if (auto reason = admit(lock, mode)) {
+        lock.unlock();
+        reject(*reason, label);
+        return false;
+      }
+      admitted_.fetch_add(1, std::memory_order_relaxed);
+    }
+    typename Tracer::stamp stamp {};
+    if constexpr (Tracer::enabled) {
+      stamp = tracer_.on_enqueue(label, tasks_.size());
+    }
+    job j {std::move(fn), label, mode == enqueue_mode::exempt, {}, stamp};
+    if (codel_.enabled()) {
+      j.enqueued = codel_controller::clock::now();
+    }
+    tasks_.push(std::move(j));
+    outstanding_.fetch_add(1, std::memory_order_relaxed);
+    if (blocked_ > 0) {
+      maybe_compensate();
+    }
+    // 先通知，后释放锁。目的是保证公平性和避免优先级倒置，因为
+    // 互斥锁一般有较完善的阻塞线程调度算法，会按照线程优先级调
+    // 度，相同优先级按照 FIFO 调度。
+    // 理想的调度是 LIFO
+    condvar_.notify_one();
+    return true;
+  }
+
+  /// 返回拒绝原因，可以接纳时返回空。调用者持有锁。
+  std::optional<reject_reason> admit(std::unique_lock<std::mutex>& lock, enqueue_mode mode)
+  {
+    if (stopped_) {
+      return reject_reason::stopped;
+    }
+    if (admission_.capacity == 0 || tasks_.size() < admission_.capacity) {
+      return std::nullopt;
+    }
+    if (mode == enqueue_mode::non_blocking || admission_.when_full == overflow_policy::reject) {
+      return reject_reason::queue_full;
+    }
+    not_full_.wait(lock, [this]() { return tasks_.size() < admission_.capacity || stopped_; });
+    return stopped_ ? std::optional {reject_reason::stopped} : std::nullopt;
+  }
+
+  ///
+  void reject(reject_reason reason, const char* label)
+  {
+    (reason == reject_reason::expired ? expired_ : rejected_).fetch_add(1, std::memory_order_relaxed);
+    if (admission_.on_rejected) {
+      admission_.on_rejected(reason, label);
+    }
+  }
+
+  /// 取出下一个可以执行的任务，CoDel 判定过期的任务放入 expired。调用者持有锁。
+  std::optional<job> pop_locked(std::vector<job>& expired)
+  {
+    std::optional<job> next;
+    const auto now = codel_.enabled() ? codel_controller::clock::now() : codel_controller::clock::time_point {};
+    while (!tasks_.empty() && !next) {
+      auto t = std::move(tasks_.front());
+      tasks_.pop();
+      if (codel_.enabled() && !t.exempt && codel_.should_drop(now, t.enqueued)) {
+        expired.push_back(std::move(t));
+      } else {
+        next.emplace(std::move(t));
+      }
+    }
+    return next;
+  }
+
+  /// 出队之后、释放锁之后的收尾：唤醒等待空位的提交者，处理过期任务。
+  void after_pop(std::vector<job>& expired)
+  {
+    if (admission_.capacity != 0) {
+      not_full_.notify_all();
+    }
+    // 在锁外回调和析构：析构 packaged_task 会唤醒等待其 future 的线程。
+    for (auto& e: expired) {
+      reject(reject_reason::expired, e.label);
+      retire_job();
+    }
+    expired.clear();
+  }
+
+  ///
+  void run(job& t)
+  {
+    if constexpr (Tracer::enabled) {
+      const auto started = trace_clock::now();
+      invoke(t);
+      tracer_.on_finish(worker_index(), t.stamp, started, trace_clock::now());
+    } else {
+      invoke(t);
+    }
+    // 先析构任务（可能持有调用者的资源），再算作完成。
+    t.fn = nullptr;
+    retire_job();
+  }
+
+  /// 异常逃出 jthread 会调用 std::terminate，在这里截住并报告。
+  void invoke(job& t) noexcept
+  {
+    try {
+      t.fn();
+    } catch (...) {
+      failed_.fetch_add(1, std::memory_order_relaxed);
+      if (admission_.on_exception) {
+        admission_.on_exception(std::current_exception(), t.label);
+      }
+    }
+  }
+
+  /// 一个入队的任务执行完或被丢弃。
+  void retire_job()
+  {
+    if (outstanding_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      // 加锁再通知，避免与 wait() 检查条件和睡眠之间的窗口交错而丢失通知。
+      auto lock = std::lock_guard {mutex_};
+      drained_.notify_all();
+    }
+  }
+
+  ///
+  void scheduled_run(std::stop_token stop, std::size_t worker, bool compensation)
+  {
+    worker_hooks::current() = this;
+    worker_index() = worker;
+    // 有看到线程池实现把 stop_token 当作一个工作投递给线程。
+    // 这样做有问题因为这不是有效的广播行为，投递n次无法保证
+    // n个不同的线程都收到工作。
+    std::vector<job> expired;
+    while (!stop.stop_requested()) {
+      auto lock = std::unique_lock {mutex_};
+      ++idle_;
+      condvar_.wait(lock, [this, &stop, compensation]() {
+        return !tasks_.empty() || stop.stop_requested() || (compensation && surplus());
+      });
+      --idle_;
+      if (stop.stop_requested()) {
+        break;
+      }
+      // 被补偿的任务已经不再阻塞，多出来的 worker 退出。
+      if (compensation && surplus()) {
+        break;
+      }
+
+      auto next = pop_locked(expired);
+      lock.unlock();
+      after_pop(expired);
+      if (next) {
+        run(*next);
+      }
+    }
+    if (compensation) {
+      retire(worker);
+    }
+    worker_hooks::current() = nullptr;
+  }
+
+  void enter_blocking() override
+  {
+    auto lock = std::lock_guard {mutex_};
+    ++blocked_;
+    maybe_compensate();
+  }
+
+  void leave_blocking() override
+  {
+    {
+      auto lock = std::lock_guard {mutex_};
+      --blocked_;
+    }
+    // 让空闲的补充 worker 检查自己是否多余。
+    condvar_.notify_all();
+  }
+
+  bool run_pending() override
+  {
+    std::vector<job> expired;
+    auto lock = std::unique_lock {mutex_};
+    auto next = pop_locked(expired);
+    lock.unlock();
+    after_pop(expired);
+    if (!next) {
+      return false;
+    }
+    run(*next);
+    return true;
+  }
+
+  /// 在线的 worker 中，未阻塞的数量已经超过 capacity。调用者持有锁。
+  bool surplus() const
+  {
+    return live_ - blocked_ > capacity_;
+  }
+
+  /// 有任务排队、没有空闲 worker、且未阻塞的 worker 少于 capacity 时补充一个。调用者持有锁。
+  void maybe_compensate()
+  {
+    if (stopped_ || tasks_.empty() || idle_ > 0 || live_ - blocked_ >= capacity_ || free_slots_.empty()) {
+      return;
+    }
+    // 顺便回收已经退出的补充 worker。它在持锁时设置 done，我们能看到说明它已不再需要锁。
+    compensation_.remove_if([](compensation_worker& c) {
+      if (c.done) {
+        c.thread.join();
+      }
+      return c.done;
+    });
+    const auto slot = free_slots_.back();
+    free_slots_.pop_back();
+    ++live_;
+    auto& c = compensation_.emplace_back();
+    c.thread = std::jthread {std::bind_front(&basic_thread_pool::scheduled_run, this), slot, true};
+  }
+
+  /// 补充 worker 退出前调用。
+  void retire(std::size_t slot)
+  {
+    auto lock = std::lock_guard {mutex_};
+    --live_;
+    free_slots_.push_back(slot);
+    for (auto&& c: compensation_) {
+      if (c.thread.get_id() == std::this_thread::get_id()) {
+        c.done = true;
+      }
+    }
+  }
+
+private:
+  // 还有另一种做法是封装线程，然后维护两个队列，一个是idle线程
+  // 队列，另一个是busy线程队列。把队列中的工作直接投递到idle线程。
+  // 需要benchmark一番，但内存开销肯定比较大。
+  std::vector<std::jthread> threads_;
+  std::queue<job> tasks_;
+  // 以下由 mutex_ 保护。
+  std::list<compensation_worker> compensation_;
+  std::vector<std::size_t> free_slots_;
+  std::size_t capacity_;
+  std::size_t live_;
+  std::size_t blocked_ {0};
+  std::size_t idle_ {0};
+  // 这里有一个难点: 要如何解耦队列锁和条件变量?
+  // 要基于什么一般抽象?
+  std::mutex mutex_;
+  std::condition_variable condvar_;
+  std::condition_variable not_full_;
+  std::condition_variable drained_;
+  std::atomic<std::size_t> outstanding_ {0};
+  bool stopped_ {false};
+  admission_control admission_;
+  codel_controller codel_;
+  std::atomic<std::uint64_t> admitted_ {0};
+  std::atomic<std::uint64_t> rejected_ {0};
+  std::atomic<std::uint64_t> expired_ {0};
+  std::atomic<std::uint64_t> failed_ {0};
+  [[no_unique_address]] Tracer tracer_;
+};
+
+using thread_pool = basic_thread_pool<>;
+using traced_thread_pool = basic_thread_pool<task_tracer>;
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+#include "thread_pool_v0.hpp"
+
+/// 每个 worker 一份的 T，下标是 worker 编号，访问是一次数组索引。
+/**
+ * 与 thread_local 相比：属于某个线程池对象而不是整个进程，可以有多个实例，
+ * 可以在任务外（线程池空闲或 join 之后）遍历所有 worker 的值做汇总。
+ * 每份按缓存行对齐，不同 worker 写各自的值不会伪共享。
+ * 只能在构造时传入的线程池的 worker 上调用 local()。
+ * @code
+ * worker_local<std::uint64_t> hits {pool};
+ * pool.post([&]() { ++hits.local(); });
+ * ...
+ * std::uint64_t total = 0;
+ * hits.for_each([&](std::uint64_t n) { total += n; });
+ * @endcode
+ */
+template<typename T>
+class worker_local
+{
+public:
+  ///
+  template<typename Pool>
+  explicit worker_local(const Pool& pool)
+    : slots_(pool.max_workers())
+  {
+  }
+
+  /// 当前 worker 的值。
+  T& local() noexcept
+  {
+    assert(worker_hooks::current() && worker_hooks::worker_index() < slots_.size());
+    return slots_[worker_hooks::worker_index()].value;
+  }
+
+  /// 遍历所有 worker 的值，调用者保证此时没有任务在访问它们。
+  template<typename Fn>
+  void for_each(Fn&& fn)
+  {
+    for (auto& s: slots_) {
+      fn(s.value);
+    }
+  }
+
+private:
+  struct alignas(64) slot
+  {
+    T value {};
+  };
+
+  std::vector<slot> slots_;
+};